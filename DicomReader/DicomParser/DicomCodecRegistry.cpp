@@ -0,0 +1,32 @@
+// dcmtk
+#include <dcmtk/dcmjpeg/djdecode.h>
+#include <dcmtk/dcmjpls/djdecode.h>
+#include <dcmtk/dcmdata/dcrledrg.h>
+// Cpp
+#include <cstdlib>
+// meta
+#include "DicomCodecRegistry.h"
+
+// public
+void DicomCodecRegistry::register_codecs()
+{
+	std::call_once(m_register_flag, []()
+	{
+		DJDecoderRegistration::registerCodecs();
+		DJLSDecoderRegistration::registerCodecs();
+		DcmRLEDecoderRegistration::registerCodecs();
+		std::atexit(cleanup_codecs);
+	});
+}
+
+// protected
+
+// private
+std::once_flag DicomCodecRegistry::m_register_flag;
+
+void DicomCodecRegistry::cleanup_codecs()
+{
+	DcmRLEDecoderRegistration::cleanup();
+	DJLSDecoderRegistration::cleanup();
+	DJDecoderRegistration::cleanup();
+}
@@ -0,0 +1,23 @@
+#pragma once
+// Cpp
+#include <mutex>
+
+/*!
+* \brief Process wide registration of the dcmtk decompression codecs
+* The JPEG, JPEG-LS and RLE decoders are registered the first time a
+* compressed slice is met and stay registered until exit. dcmtk guards its
+* codec list with a read/write lock, so slices decompress on any number of
+* threads once registration is done.
+*/
+class DicomCodecRegistry
+{
+public:
+	static void register_codecs();
+
+protected:
+
+private:
+	static std::once_flag m_register_flag;
+
+	static void cleanup_codecs();
+};
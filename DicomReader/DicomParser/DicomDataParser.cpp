@@ -2,17 +2,28 @@
 #include <dcmtk/ofstd/ofcond.h>
 #include <dcmtk/dcmdata/dcfilefo.h>
 #include <dcmtk/dcmdata/dcdeftag.h>
-#include <dcmtk/dcmjpeg/djdecode.h>
+#include <dcmtk/dcmdata/dcxfer.h>
 // meta
 #include "DicomDataParser.h"
+#include "DicomCodecRegistry.h"
+#include "DicomJ2kDecoder.h"
+#include "DicomMappedFile.h"
+#include "DicomPixelKernels.h"
+#include "DicomSliceCache.h"
 /*#include "../DICOMReader/DcmHandler.h"*/
 
 #include<vector>
+#include<algorithm>
 #include<iostream>
 using namespace std;
 
 // public
-DicomDataParser::DicomDataParser()
+DicomDataParser::DicomDataParser() :
+	m_kernel_ready(false),
+	m_kernel_bit_num(0),
+	m_kernel_planar_configuration(0),
+	m_kernel_rescale_slope(1.0f),
+	m_kernel_rescale_intercept(0.0f)
 {
 
 }
@@ -21,7 +32,40 @@ DicomDataParser::~DicomDataParser()
 {
 }
 
+bool DicomDataParser::prepare_series(int bit_num, std::string &sample_num, std::string &modality,
+	float rescale_slope, float rescale_intercept, int planarConfiguration)
+{
+	m_kernel_ready = DicomPixelKernels::select(bit_num, sample_num, planarConfiguration, modality,
+		rescale_slope, rescale_intercept, m_kernel);
+	m_kernel_bit_num = bit_num;
+	m_kernel_sample_num = sample_num;
+	m_kernel_planar_configuration = planarConfiguration;
+	m_kernel_modality = modality;
+	m_kernel_rescale_slope = rescale_slope;
+	m_kernel_rescale_intercept = rescale_intercept;
+	return m_kernel_ready;
+}
+
 bool DicomDataParser::get_data_slice(std::string file_path, short *buffer,
+	int width, int height, int bit_num, std::string &sample_num,
+	std::string &modality, float rescale_slope, float rescale_intercept, int planarConfiguration,
+	DcmFileFormat* file_format, const char *sop)
+{
+	// 0ѽĲֱӴӻȡ, ļ
+	DicomSliceCache *l_slice_cache = DicomSliceCache::get_instance();
+	size_t l_value_num = (size_t)width * height * std::max(atoi(sample_num.c_str()), 1);
+	bool l_use_cache = sop != NULL && l_slice_cache->enabled();
+	if (l_use_cache && l_slice_cache->get(sop, rescale_slope, rescale_intercept, buffer, l_value_num))
+		return true;
+
+	bool l_ret = decode_data_slice(file_path, buffer, width, height, bit_num, sample_num,
+		modality, rescale_slope, rescale_intercept, planarConfiguration, file_format);
+	if (l_ret && l_use_cache)
+		l_slice_cache->put(sop, rescale_slope, rescale_intercept, buffer, l_value_num);
+	return l_ret;
+}
+
+bool DicomDataParser::decode_data_slice(std::string &file_path, short *buffer,
 	int width, int height, int bit_num, std::string &sample_num,
 	std::string &modality, float rescale_slope, float rescale_intercept, int planarConfiguration,DcmFileFormat* file_format)//file_format:dcmtk
 {
@@ -38,7 +82,6 @@ bool DicomDataParser::get_data_slice(std::string file_path, short *buffer,
 		file_format = &l_file_format;
     } else {
         //l_status = handler.loadDicomFile(*byte_array);
-		l_file_format = *file_format;
     }
 
 
@@ -50,44 +93,36 @@ bool DicomDataParser::get_data_slice(std::string file_path, short *buffer,
         l_dataset = file_format->getDataset();
     }
 
-	Uint16 l_pixel_representation;
-	l_status = l_dataset->findAndGetUint16(DCM_PixelRepresentation, l_pixel_representation);
-	if (l_pixel_representation != EXS_LittleEndianExplicit)
+	// JPEG 2000 has no dcmtk codec, the frame goes through OpenJPEG in the series layout
+	if (DicomJ2kDecoder::is_j2k(l_dataset->getOriginalXfer()))
 	{
-		// REMARK ̲̿߳ȫģΪȫֻ
-		/*m_jpeg_decoder_mutex.lock();*/
-		DJDecoderRegistration::registerCodecs(); // register JPEG codecs
-		
-
-		E_TransferSyntax xfer = l_dataset->getOriginalXfer(); 
-		l_status = l_dataset->chooseRepresentation(xfer, NULL);
-		if (l_dataset->canWriteXfer(xfer))
+		const size_t l_frame_bytes = (size_t)width * height * std::max(atoi(sample_num.c_str()), 1) * (bit_num / 8);
+		std::vector<unsigned char> l_frame_buffer(l_frame_bytes);
+		DicomJ2kDecoder l_j2k_decoder;
+		if (!l_j2k_decoder.open(l_dataset, 1) || !l_j2k_decoder.decode_frame(0, l_frame_buffer.data(), l_frame_bytes,
+			bit_num, std::max(atoi(sample_num.c_str()), 1), planarConfiguration))
 		{
-			DicomImage* dcmImage = new DicomImage(l_dataset, xfer); //DicomImage
-			dcmImage->setMinMaxWindow();        //Զ
-			//dcmImage->writeBMP("myoutput.bmp");//Ϊbmpʽ 
+			cout << "JPEG 2000 ѹ" << file_path << endl;
+			return false;
 		}
+		if (bit_num == 8)
+			return convert_slice(file_path, buffer, l_frame_buffer.data(), nullptr, (unsigned long)l_frame_bytes,
+				width, height, bit_num, sample_num, modality, rescale_slope, rescale_intercept, planarConfiguration);
+		return convert_slice(file_path, buffer, nullptr, (const unsigned short *)l_frame_buffer.data(), (unsigned long)(l_frame_bytes / 2),
+			width, height, bit_num, sample_num, modality, rescale_slope, rescale_intercept, planarConfiguration);
+	}
 
-
+	// only encapsulated transfer syntaxes need the decoders
+	if (DcmXfer(l_dataset->getOriginalXfer()).isEncapsulated())
+	{
+		DicomCodecRegistry::register_codecs();
 		// decompress dataset if compressed
 		l_status = l_dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr);
-
-		// check if everything went well
-		if (l_dataset->canWriteXfer(EXS_LittleEndianExplicit))
-		{
-			//file_format->saveFile("test_decompressed.dcm", EXS_LittleEndianExplicit);
-		}
-
 		if(l_status.bad())
 		{
 			cout<<"ѹ"<<endl;
 		    return false;
 		}
-
-
-		// check if everything went well
-		DJDecoderRegistration::cleanup(); // deregister JPEG codecs
-		/*m_jpeg_decoder_mutex.unlock();*/
 	}
 
 	/*
@@ -163,115 +198,45 @@ bool DicomDataParser::get_data_slice(std::string file_path, short *buffer,
 		return false;
 		break;
 	}
-	// 4ݳ
-	int l_assumed_pixel_num = width * height;
-	if ((sample_num == "1" && l_assumed_pixel_num != l_data_read_count) ||
-		(sample_num == "3" && l_assumed_pixel_num * 3 != l_data_read_count &&
-		 l_assumed_pixel_num * 3 != l_data_read_count - 1))
-	{
-		std::cout << "Slice data size err: " << l_assumed_pixel_num << "(" <<  //error 
-			l_data_read_count << ") | " << file_path << std::endl;
+	// 45ݳȲ
+	return convert_slice(file_path, buffer, l_temp_8bit_buffer, l_temp_16bit_buffer, l_data_read_count,
+		width, height, bit_num, sample_num, modality, rescale_slope, rescale_intercept, planarConfiguration);
+}
+
+bool DicomDataParser::get_data_slice_mapped(std::string file_path, short *buffer,
+	int width, int height, int bit_num, std::string &sample_num,
+	std::string &modality, float rescale_slope, float rescale_intercept, int planarConfiguration)
+{
+	if (bit_num != 8 && bit_num != 16)
+		return false;
+	// 1ӳļλPixelData, ѹݽdcmtk
+	DicomMappedFile l_mapped_file;
+	size_t l_offset = 0;
+	size_t l_length = 0;
+	if (!l_mapped_file.open(file_path) || !l_mapped_file.locate_pixel_data(l_offset, l_length))
 		return false;
-	}
 
-	// 5ݺ
-	switch (bit_num)
+	// 2ֱӴӳҳȡ
+	const unsigned char *l_temp_8bit_buffer = nullptr;
+	const unsigned short *l_temp_16bit_buffer = nullptr;
+	unsigned long l_data_read_count = 0;
+	if (bit_num == 8)
 	{
-	case 8:
-		if (sample_num == "1")
-		{
-			for (int i = 0; i < l_assumed_pixel_num; ++i)
-			{
-				short l_value = l_temp_8bit_buffer[i];
-				buffer[i] = (short)(l_value * rescale_slope + rescale_intercept);
-			}
-		}
-		else if (sample_num == "3")
-		{
-			int count = 0;
-			for (int i = 0; i < l_assumed_pixel_num; ++i)
-			{
-				if (planarConfiguration == 1)
-				{
-					buffer[count] = (short)(l_temp_8bit_buffer[i]);
-					buffer[count + 1] = (short)(l_temp_8bit_buffer[l_assumed_pixel_num + i]);
-					buffer[count + 2] = (short)(l_temp_8bit_buffer[l_assumed_pixel_num * 2 + i]);
-				}
-				else
-				{
-					buffer[count] = (short)(l_temp_8bit_buffer[3*i]);
-					buffer[count + 1] = (short)(l_temp_8bit_buffer[3*i + 1]);
-					buffer[count + 2] = (short)(l_temp_8bit_buffer[3*i + 2]);
-				}
-				count += 3;
-			}
-		}
-		else
-		{
-			std::cout << "Slice sample num err: " << sample_num << " | " << file_path << std::endl;
-			return false;
-		}
-		break;
-	case 16:
-		if (sample_num == "1")
-		{
-			if (modality == "DR")
-			{
-				if (rescale_slope < 0.0001)
-				{
-					for (int i = 0; i < l_assumed_pixel_num; ++i)
-					{
-						short l_value = l_temp_16bit_buffer[i] ;
-						buffer[i] = (short)(l_value + rescale_intercept);
-					}
-				}
-				else
-				{
-					for (int i = 0; i < l_assumed_pixel_num; ++i)
-					{
-						short l_value = l_temp_16bit_buffer[i] ;
-						buffer[i] = (short)(l_value * rescale_slope + rescale_intercept);
-					}
-				}
-			}
-			else
-			{
-				int l_label_flag = 0;
-				for (int i = 0; i < l_assumed_pixel_num; ++i)
-				{
-					short l_value = l_temp_16bit_buffer[i];
-					l_value = (short)(l_value * rescale_slope + rescale_intercept);
-					buffer[i] = l_value;
-					if (l_value == -1024 || l_value == -1025)
-						++l_label_flag;
-				}
-				if (l_label_flag == l_assumed_pixel_num)
-				{
-					if (l_assumed_pixel_num > 0)
-					{
-						for (int i = 0; i < l_assumed_pixel_num; ++i)
-							if(buffer[i] == -1024)
-								buffer[i] = -2048;
-							else
-								buffer[i] = 2048;
-					}
-				}
-			}
-		}
-		else
-		{
-			std::cout << "Slice sample num err: " << sample_num << " | " << file_path << std::endl;
+		l_temp_8bit_buffer = l_mapped_file.data() + l_offset;
+		l_data_read_count = (unsigned long)l_length;
+	}
+	else
+	{
+		// 16 bit view needs an even offset
+		if (l_offset % 2 != 0)
 			return false;
-		}
-
-		break;
-	}//end switch
-	if (l_temp_16bit_buffer != nullptr)
-		l_temp_16bit_buffer = nullptr;
-	if (l_temp_8bit_buffer != nullptr)
-		l_temp_8bit_buffer = nullptr;
+		l_temp_16bit_buffer = (const unsigned short *)(l_mapped_file.data() + l_offset);
+		l_data_read_count = (unsigned long)(l_length / 2);
+	}
 
-	return true;
+	// ʧʱ÷˵dcmtk, ﱨһδ
+	return convert_slice(file_path, buffer, l_temp_8bit_buffer, l_temp_16bit_buffer, l_data_read_count,
+		width, height, bit_num, sample_num, modality, rescale_slope, rescale_intercept, planarConfiguration, false);
 }
 
 bool DicomDataParser::get_data_slice_overlay(std::string &file_path, short *buffer,
@@ -304,18 +269,12 @@ bool DicomDataParser::get_data_slice_overlay(std::string &file_path, short *buff
     } else {
         l_dataset = file_format->getDataset();
     }
-	Uint16 l_pixel_representation;
-	l_status = l_dataset->findAndGetUint16(DCM_PixelRepresentation, l_pixel_representation);
-	if (l_pixel_representation != EXS_LittleEndianExplicit)
+	// only encapsulated transfer syntaxes need the decoders
+	if (DcmXfer(l_dataset->getOriginalXfer()).isEncapsulated())
 	{
-		// REMARK ̲̿߳ȫģΪȫֻ
-		/*m_jpeg_decoder_mutex.lock();*/
-		DJDecoderRegistration::registerCodecs(); // register JPEG codecs
+		DicomCodecRegistry::register_codecs();
 		// decompress dataset if compressed
 		l_dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr);
-		// check if everything went well
-		DJDecoderRegistration::cleanup(); // deregister JPEG codecs
-		/*m_jpeg_decoder_mutex.unlock();*/
 	}
 
 
@@ -499,6 +458,58 @@ bool DicomDataParser::get_data_slice_overlay(std::string &file_path, short *buff
 }
 
 // protected
-/*QMutex DicomDataParser::m_jpeg_decoder_mutex;*/
 
-// private
\ No newline at end of file
+// private
+bool DicomDataParser::kernel_matches(int bit_num, const std::string &sample_num, int planarConfiguration,
+	const std::string &modality, float rescale_slope, float rescale_intercept) const
+{
+	return m_kernel_ready && m_kernel_bit_num == bit_num && m_kernel_sample_num == sample_num &&
+		m_kernel_planar_configuration == planarConfiguration && m_kernel_modality == modality &&
+		m_kernel_rescale_slope == rescale_slope && m_kernel_rescale_intercept == rescale_intercept;
+}
+
+bool DicomDataParser::convert_slice(std::string &file_path, short *buffer,
+	const unsigned char *l_temp_8bit_buffer, const unsigned short *l_temp_16bit_buffer, unsigned long l_data_read_count,
+	int width, int height, int bit_num, std::string &sample_num,
+	std::string &modality, float rescale_slope, float rescale_intercept, int planarConfiguration,
+	bool report_errors)
+{
+	// 4ݳ
+	int l_assumed_pixel_num = width * height;
+	if ((sample_num == "1" && l_assumed_pixel_num != l_data_read_count) ||
+		(sample_num == "3" && l_assumed_pixel_num * 3 != l_data_read_count &&
+		 l_assumed_pixel_num * 3 != l_data_read_count - 1))
+	{
+		if (report_errors)
+			std::cout << "Slice data size err: " << l_assumed_pixel_num << "(" <<  //error 
+				l_data_read_count << ") | " << file_path << std::endl;
+		return false;
+	}
+
+	// 5ݺ, һʱֱʹмѡõkernel
+	DicomPixelKernel l_kernel = m_kernel;
+	if (!kernel_matches(bit_num, sample_num, planarConfiguration, modality, rescale_slope, rescale_intercept))
+	{
+		if (!DicomPixelKernels::select(bit_num, sample_num, planarConfiguration, modality,
+			rescale_slope, rescale_intercept, l_kernel))
+		{
+			if (report_errors)
+				std::cout << "Slice sample num err: " << sample_num << " | " << file_path << std::endl;
+			return false;
+		}
+	}
+
+	const void *l_src = bit_num == 8 ? (const void *)l_temp_8bit_buffer : (const void *)l_temp_16bit_buffer;
+	int l_label_flag = l_kernel.func(l_src, buffer, l_assumed_pixel_num,
+		l_kernel.rescale_slope, l_kernel.rescale_intercept);
+	if (l_kernel.label_check && l_label_flag == l_assumed_pixel_num && l_assumed_pixel_num > 0)
+	{
+		for (int i = 0; i < l_assumed_pixel_num; ++i)
+			if (buffer[i] == -1024)
+				buffer[i] = -2048;
+			else
+				buffer[i] = 2048;
+	}
+
+	return true;
+}
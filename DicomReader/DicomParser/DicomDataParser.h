@@ -9,6 +9,8 @@
 #include "dcmtk/config/osconfig.h"    /* make sure OS specific configuration is included first */
 #include "dcmtk/dcmdata/dctk.h" 
 #include "dcmtk/dcmdata/dcpxitem.h" 
+// local
+#include "DicomPixelKernels.h"
 class DcmFileFormat;
 class /*CENTRALMANAGER_EXPORT*/ DicomDataParser
 {
@@ -16,19 +18,49 @@ public:
 	DicomDataParser();
 	~DicomDataParser();
 
+	// Picks the conversion kernel once per series, get_data_slice then skips the per slice selection
+	bool prepare_series(int bit_num, std::string &sample_num, std::string &modality,
+		float rescale_slope, float rescale_intercept, int planarConfiguration);
+
 	bool get_data_slice(std::string file_path, short *buffer,
 		int width, int height, int bit_num, std::string &sample_num,
 		std::string &modality, float rescale_slope, float rescale_intercept,
-        int planarConfiguration,DcmFileFormat* file_format=NULL);
+        int planarConfiguration,DcmFileFormat* file_format=NULL, const char *sop=NULL);  //a non NULL sop looks up DicomSliceCache first
 	bool get_data_slice_overlay(std::string &file_path, short *buffer,
 		int width, int height, int bit_num, std::string &sample_num,
 		std::string &modality, float rescale_slope, float rescale_intercept,
 		int overlay_row, int overlay_column,int overlay_row_ori,
 		int planarConfiguration, int overlay_column_ori, int overlay_bit_allocate, DcmFileFormat* file_format = NULL);
+	// Uncompressed little endian data is read straight from a file mapping, otherwise false and get_data_slice takes over
+	bool get_data_slice_mapped(std::string file_path, short *buffer,
+		int width, int height, int bit_num, std::string &sample_num,
+		std::string &modality, float rescale_slope, float rescale_intercept,
+		int planarConfiguration);
 
 protected:
-	/*static QMutex m_jpeg_decoder_mutex;*/
 
 private:
+	DicomPixelKernel m_kernel;
+	bool m_kernel_ready;
+	// every input of prepare_series, a slice differing in any of them selects its own kernel
+	int m_kernel_bit_num;
+	std::string m_kernel_sample_num;
+	int m_kernel_planar_configuration;
+	std::string m_kernel_modality;
+	float m_kernel_rescale_slope;
+	float m_kernel_rescale_intercept;
+
+	bool kernel_matches(int bit_num, const std::string &sample_num, int planarConfiguration,
+		const std::string &modality, float rescale_slope, float rescale_intercept) const;
 
+	bool decode_data_slice(std::string &file_path, short *buffer,
+		int width, int height, int bit_num, std::string &sample_num,
+		std::string &modality, float rescale_slope, float rescale_intercept,
+		int planarConfiguration, DcmFileFormat* file_format);
+
+	bool convert_slice(std::string &file_path, short *buffer,
+		const unsigned char *l_temp_8bit_buffer, const unsigned short *l_temp_16bit_buffer, unsigned long l_data_read_count,
+		int width, int height, int bit_num, std::string &sample_num,
+		std::string &modality, float rescale_slope, float rescale_intercept, int planarConfiguration,
+		bool report_errors = true);   //false: the caller falls back and reports the failure
 };
\ No newline at end of file
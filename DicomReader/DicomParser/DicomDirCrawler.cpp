@@ -0,0 +1,211 @@
+#ifdef _WIN32
+// windows
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+// Cpp
+#include <algorithm>
+#include <cstring>
+// meta
+#include "DicomDirCrawler.h"
+
+#ifdef _WIN32
+const char DicomDirCrawler::ms_separator = '\\';
+#else
+const char DicomDirCrawler::ms_separator = '/';
+#endif
+
+// public
+DicomDirCrawler::DicomDirCrawler(size_t queue_capacity) :
+	m_queue_capacity(std::max<size_t>(queue_capacity, 1)),
+	m_done(true),
+	m_stopped(false)
+{
+}
+
+DicomDirCrawler::~DicomDirCrawler()
+{
+	stop();
+}
+
+bool DicomDirCrawler::start(const std::string &folder_path, bool recursive)
+{
+	if (m_thread.joinable() || !is_directory(folder_path))
+		return false;
+	m_queue.clear();
+	m_done = false;
+	m_stopped = false;
+	m_thread = std::thread(&DicomDirCrawler::crawl, this, folder_path, recursive);
+	return true;
+}
+
+bool DicomDirCrawler::next_file(DicomCrawlEntry &entry)
+{
+	std::unique_lock<std::mutex> l_lock(m_mutex);
+	m_not_empty_cv.wait(l_lock, [this]() { return !m_queue.empty() || m_done || m_stopped; });
+	if (m_queue.empty() || m_stopped)
+		return false;
+	entry = std::move(m_queue.front());
+	m_queue.pop_front();
+	l_lock.unlock();
+	m_not_full_cv.notify_one();
+	return true;
+}
+
+void DicomDirCrawler::stop()
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_stopped = true;
+	}
+	m_not_full_cv.notify_all();
+	m_not_empty_cv.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+bool DicomDirCrawler::list(const std::string &folder_path, bool recursive, std::vector<DicomCrawlEntry> &entries)
+{
+	entries.clear();
+	if (!is_directory(folder_path))
+		return false;
+	std::vector<std::string> l_dirs(1, folder_path);
+	while (!l_dirs.empty())
+	{
+		std::string l_dir = l_dirs.back();
+		l_dirs.pop_back();
+		std::vector<std::string> l_sub_dirs;
+		read_dir(l_dir, entries, l_sub_dirs);
+		if (recursive)
+			l_dirs.insert(l_dirs.end(), l_sub_dirs.rbegin(), l_sub_dirs.rend());
+	}
+	std::sort(entries.begin(), entries.end(), [](const DicomCrawlEntry &a, const DicomCrawlEntry &b) {
+		return a.file_path < b.file_path;
+	});
+	return true;
+}
+
+// protected
+
+// private
+void DicomDirCrawler::crawl(std::string folder_path, bool recursive)
+{
+	// depth first, a series folder is finished before the next one starts
+	std::vector<std::string> l_dirs(1, folder_path);
+	while (!l_dirs.empty())
+	{
+		std::string l_dir = l_dirs.back();
+		l_dirs.pop_back();
+		std::vector<DicomCrawlEntry> l_files;
+		std::vector<std::string> l_sub_dirs;
+		read_dir(l_dir, l_files, l_sub_dirs);
+		for (int i = 0; i < l_files.size(); ++i)
+		{
+			if (!push(l_files[i]))
+				return;
+		}
+		if (recursive)
+			l_dirs.insert(l_dirs.end(), l_sub_dirs.rbegin(), l_sub_dirs.rend());
+	}
+
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_done = true;
+	}
+	m_not_empty_cv.notify_all();
+}
+
+bool DicomDirCrawler::push(DicomCrawlEntry &entry)
+{
+	std::unique_lock<std::mutex> l_lock(m_mutex);
+	m_not_full_cv.wait(l_lock, [this]() { return m_queue.size() < m_queue_capacity || m_stopped; });
+	if (m_stopped)
+		return false;
+	m_queue.push_back(std::move(entry));
+	l_lock.unlock();
+	m_not_empty_cv.notify_one();
+	return true;
+}
+
+bool DicomDirCrawler::is_directory(const std::string &path)
+{
+#ifdef _WIN32
+	DWORD l_attributes = GetFileAttributesA(path.c_str());
+	return l_attributes != INVALID_FILE_ATTRIBUTES && (l_attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat l_stat;
+	return stat(path.c_str(), &l_stat) == 0 && S_ISDIR(l_stat.st_mode);
+#endif
+}
+
+bool DicomDirCrawler::read_dir(const std::string &dir_path, std::vector<DicomCrawlEntry> &files,
+	std::vector<std::string> &sub_dirs)
+{
+	std::string l_prefix = dir_path;
+	if (!l_prefix.empty() && l_prefix.back() != ms_separator && l_prefix.back() != '/')
+		l_prefix += ms_separator;
+#ifdef _WIN32
+	// basic info skips the short names, large fetch returns the listing in bigger batches
+	WIN32_FIND_DATAA l_find_data;
+	HANDLE l_find = FindFirstFileExA((l_prefix + "*").c_str(), FindExInfoBasic, &l_find_data,
+		FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (l_find == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		const char *l_name = l_find_data.cFileName;
+		if (strcmp(l_name, ".") == 0 || strcmp(l_name, "..") == 0)
+			continue;
+		if (l_find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			sub_dirs.push_back(l_prefix + l_name);
+		}
+		else
+		{
+			DicomCrawlEntry l_entry;
+			l_entry.file_path = l_prefix + l_name;
+			l_entry.file_size = ((unsigned long long)l_find_data.nFileSizeHigh << 32) | l_find_data.nFileSizeLow;
+			files.push_back(std::move(l_entry));
+		}
+	} while (FindNextFileA(l_find, &l_find_data));
+	FindClose(l_find);
+#else
+	DIR *l_dir = opendir(dir_path.c_str());
+	if (l_dir == NULL)
+		return false;
+	struct dirent *l_dirent;
+	while ((l_dirent = readdir(l_dir)) != NULL)
+	{
+		const char *l_name = l_dirent->d_name;
+		if (strcmp(l_name, ".") == 0 || strcmp(l_name, "..") == 0)
+			continue;
+		std::string l_path = l_prefix + l_name;
+		// d_type saves the stat on most file systems, size is left unknown then
+		unsigned char l_type = l_dirent->d_type;
+		unsigned long long l_size = ~0ULL;
+		if (l_type == DT_UNKNOWN)
+		{
+			struct stat l_stat;
+			if (stat(l_path.c_str(), &l_stat) != 0)
+				continue;
+			l_type = S_ISDIR(l_stat.st_mode) ? DT_DIR : DT_REG;
+			l_size = l_stat.st_size;
+		}
+		if (l_type == DT_DIR)
+		{
+			sub_dirs.push_back(l_path);
+		}
+		else
+		{
+			DicomCrawlEntry l_entry;
+			l_entry.file_path = l_path;
+			l_entry.file_size = l_size;
+			files.push_back(std::move(l_entry));
+		}
+	}
+	closedir(l_dir);
+#endif
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct DicomCrawlEntry
+{
+	std::string file_path;
+	// taken from the directory listing, no separate stat per file
+	unsigned long long file_size;
+};
+
+/*!
+* \brief Directory crawler feeding the header pass
+* A background thread walks the folder (and its subfolders when recursive)
+* and pushes files into a bounded queue, the header parser threads pop from
+* it, so enumeration of a large tree overlaps the header work instead of
+* running before it. File sizes come with the listing: FindFirstFileEx with
+* large fetch on windows, readdir d_type on POSIX.
+*/
+class DicomDirCrawler
+{
+public:
+	DicomDirCrawler(size_t queue_capacity = 4096);
+	~DicomDirCrawler();
+
+	static const char ms_separator;
+
+	// Enumerate on a background thread, false when folder_path is not a directory
+	bool start(const std::string &folder_path, bool recursive);
+	// Blocks for the next file, false once the walk is done and the queue drained
+	bool next_file(DicomCrawlEntry &entry);
+	void stop();
+
+	// Blocking walk into a sorted list
+	static bool list(const std::string &folder_path, bool recursive, std::vector<DicomCrawlEntry> &entries);
+
+protected:
+
+private:
+	std::deque<DicomCrawlEntry> m_queue;
+	size_t m_queue_capacity;
+	bool m_done;
+	bool m_stopped;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty_cv;
+	std::condition_variable m_not_full_cv;
+	std::thread m_thread;
+
+	void crawl(std::string folder_path, bool recursive);
+	bool push(DicomCrawlEntry &entry);
+
+	static bool is_directory(const std::string &path);
+	// One directory level, files and subdirectories
+	static bool read_dir(const std::string &dir_path, std::vector<DicomCrawlEntry> &files,
+		std::vector<std::string> &sub_dirs);
+};
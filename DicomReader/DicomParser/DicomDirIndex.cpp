@@ -0,0 +1,192 @@
+// dcmtk
+#include <dcmtk/dcmdata/dcdicdir.h>
+#include <dcmtk/dcmdata/dcdirrec.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+// local
+#include "DicomDataMgr.h"
+#include "DicomHeaderParser.h"
+#include "DicomIndexCache.h"
+// meta
+#include "DicomDirIndex.h"
+// Cpp
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+#ifdef _WIN32
+static const char gs_separator = '\\';
+#else
+static const char gs_separator = '/';
+#endif
+
+// public
+DicomDirIndex::DicomDirIndex(DicomDataMgr *data_mgr, int thread_num) :
+	m_data_mgr(data_mgr),
+	m_thread_num(std::max(thread_num, 1))
+{
+}
+
+DicomDirIndex::~DicomDirIndex()
+{
+}
+
+std::string DicomDirIndex::find_dicomdir(const std::string &folder_path)
+{
+	std::string l_prefix = folder_path;
+	if (!l_prefix.empty() && l_prefix.back() != '\\' && l_prefix.back() != '/')
+		l_prefix += gs_separator;
+	// the standard name is upper case, lower case shows up on some exports
+	const char *l_names[] = { "DICOMDIR", "dicomdir" };
+	for (int i = 0; i < 2; ++i)
+	{
+		long long l_size, l_mtime;
+		std::string l_path = l_prefix + l_names[i];
+		if (DicomIndexCache::stat_file(l_path, l_size, l_mtime) && l_size > 0)
+			return l_path;
+	}
+	return std::string();
+}
+
+bool DicomDirIndex::load(const std::string &dicomdir_path, DicomHeaderParser &header_parser)
+{
+	m_file_paths.clear();
+	DcmDicomDir l_dicomdir(dicomdir_path.c_str());
+	if (l_dicomdir.error().bad())
+	{
+		std::cout << "DICOMDIR read failed: " << dicomdir_path << std::endl;
+		return false;
+	}
+
+	// referenced file ids are relative to the folder holding the DICOMDIR
+	std::string l_base_dir;
+	size_t l_slash = dicomdir_path.find_last_of("\\/");
+	if (l_slash != std::string::npos)
+		l_base_dir = dicomdir_path.substr(0, l_slash + 1);
+
+	DcmDirectoryRecord &l_root = l_dicomdir.getRootRecord();
+	for (DcmDirectoryRecord *l_patient = l_root.nextSub(NULL); l_patient != NULL; l_patient = l_root.nextSub(l_patient))
+	{
+		if (l_patient->getRecordType() != ERT_Patient)
+			continue;
+		for (DcmDirectoryRecord *l_study = l_patient->nextSub(NULL); l_study != NULL; l_study = l_patient->nextSub(l_study))
+		{
+			if (l_study->getRecordType() != ERT_Study)
+				continue;
+			for (DcmDirectoryRecord *l_series = l_study->nextSub(NULL); l_series != NULL; l_series = l_study->nextSub(l_series))
+			{
+				if (l_series->getRecordType() == ERT_Series)
+					load_series(l_patient, l_study, l_series, l_base_dir, header_parser);
+			}
+		}
+	}
+	return !m_file_paths.empty();
+}
+
+// protected
+
+// private
+bool DicomDirIndex::load_series(DcmDirectoryRecord *patient_record, DcmDirectoryRecord *study_record,
+	DcmDirectoryRecord *series_record, const std::string &base_dir, DicomHeaderParser &header_parser)
+{
+	std::vector<ImageRecord> l_images;
+	for (DcmDirectoryRecord *l_record = series_record->nextSub(NULL); l_record != NULL; l_record = series_record->nextSub(l_record))
+	{
+		ImageRecord l_image;
+		if (l_record->getRecordType() == ERT_Image && read_image_record(l_record, base_dir, l_image))
+			l_images.push_back(l_image);
+	}
+
+	// the first image goes through the normal header parse, it creates the nodes and the series pixel format
+	int l_first = 0;
+	while (l_first < l_images.size() && !header_parser.parse_header_info(l_images[l_first].file_path))
+		++l_first;
+	if (l_first == l_images.size())
+		return false;
+	for (int i = 0; i <= l_first; ++i)
+		m_file_paths.push_back(l_images[i].file_path);
+
+	// find those nodes by the record keys, when the records disagree with the files parse every file
+	std::string l_patient_ID = record_string(patient_record, DCM_PatientID);
+	if (l_patient_ID.empty())
+		l_patient_ID = "nameNotRecord";
+	std::string l_study_ID = record_string(study_record, DCM_StudyID);
+	std::string l_series_number = record_string(series_record, DCM_SeriesNumber);
+	int l_patient_idx, l_study_idx, l_series_idx;
+	bool l_keys_match = m_data_mgr->check_patient_available(l_patient_ID, l_patient_idx)
+		&& m_data_mgr->check_study_available(l_patient_idx, l_study_ID, l_study_idx)
+		&& m_data_mgr->check_series_available(l_patient_idx, l_study_idx, l_series_number, l_series_idx);
+	if (!l_keys_match)
+	{
+		for (int i = l_first + 1; i < l_images.size(); ++i)
+		{
+			if (header_parser.parse_header_info(l_images[i].file_path))
+				m_file_paths.push_back(l_images[i].file_path);
+		}
+		return true;
+	}
+
+	// the other slices come from the records, files are only read for missing slice tags
+	const int l_image_num = l_images.size();
+	std::vector<char> l_image_good(l_image_num, 1);
+#pragma omp parallel for num_threads(m_thread_num) schedule(dynamic)
+	for (int i = l_first + 1; i < l_image_num; ++i)
+	{
+		if (l_images[i].sop.empty() || l_images[i].location != l_images[i].location)
+			l_image_good[i] = read_slice_tags(l_images[i]) ? 1 : 0;
+	}
+	for (int i = l_first + 1; i < l_image_num; ++i)
+	{
+		if (!l_image_good[i])
+			continue;
+		m_data_mgr->append_slice(l_images[i].sop, l_patient_idx, l_study_idx, l_series_idx,
+			l_images[i].instance_num, l_images[i].location, l_images[i].file_path);
+		m_file_paths.push_back(l_images[i].file_path);
+	}
+	return true;
+}
+
+std::string DicomDirIndex::record_string(DcmDirectoryRecord *record, const DcmTagKey &tag)
+{
+	OFString l_tmp_str;
+	if (record->findAndGetOFStringArray(tag, l_tmp_str).good())
+		return l_tmp_str.c_str();
+	return std::string();
+}
+
+bool DicomDirIndex::read_image_record(DcmDirectoryRecord *record, const std::string &base_dir, ImageRecord &image)
+{
+	// the components of the multi valued Referenced File ID are the path levels
+	std::string l_file_id = record_string(record, DCM_ReferencedFileID);
+	if (l_file_id.empty())
+		return false;
+	for (int i = 0; i < l_file_id.size(); ++i)
+	{
+		if (l_file_id[i] == '\\')
+			l_file_id[i] = gs_separator;
+	}
+	image.file_path = base_dir + l_file_id;
+	image.sop = record_string(record, DCM_ReferencedSOPInstanceUIDInFile);
+	std::string l_instance = record_string(record, DCM_InstanceNumber);
+	image.instance_num = l_instance.empty() ? 0 : static_cast<unsigned short>(atoi(l_instance.c_str()));
+	std::string l_location = record_string(record, DCM_SliceLocation);
+	image.location = l_location.empty() ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(atof(l_location.c_str()));
+	return true;
+}
+
+bool DicomDirIndex::read_slice_tags(ImageRecord &image)
+{
+	// SOP instance UID and slice location are in groups 0008/0020, the read stops at group 0028
+	DcmFileFormat l_file_format;
+	OFCondition l_status = l_file_format.loadFileUntilTag(image.file_path.c_str(), EXS_Unknown, EGL_noChange,
+		DCM_MaxReadLength, ERM_autoDetect, DCM_SamplesPerPixel);
+	if (l_status.bad())
+		return false;
+	DcmDataset *l_dataset = l_file_format.getDataset();
+	OFString l_tmp_str;
+	if (image.sop.empty() && l_dataset->findAndGetOFString(DCM_SOPInstanceUID, l_tmp_str).good())
+		image.sop = l_tmp_str.c_str();
+	if (image.location != image.location && l_dataset->findAndGetOFString(DCM_SliceLocation, l_tmp_str).good())
+		image.location = static_cast<float>(atof(l_tmp_str.c_str()));
+	return !image.sop.empty();
+}
@@ -0,0 +1,61 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+// local
+class DicomDataMgr;
+class DicomHeaderParser;
+class DcmDirectoryRecord;
+class DcmTagKey;
+
+/*!
+* \brief Builds the patient/study/series tree from a DICOMDIR
+* The hierarchy and the slice list come from the directory records, so a
+* CD/USB export is indexed without parsing every image. Only the first image
+* of each series is parsed, for the pixel format tags the DICOMDIR does not
+* carry; other images are opened (up to the image pixel module) only when
+* their record lacks the SOP instance UID or the slice location.
+*/
+class DicomDirIndex
+{
+public:
+	DicomDirIndex(DicomDataMgr *data_mgr, int thread_num = 1);
+	~DicomDirIndex();
+
+	// Path of the DICOMDIR in folder_path, empty when there is none
+	static std::string find_dicomdir(const std::string &folder_path);
+
+	/*!
+	* \brief Fill the data manager from dicomdir_path
+	* header_parser parses the first image of every series and sets the
+	* profile of that pass. Series whose records do not match their images
+	* are parsed file by file.
+	*/
+	bool load(const std::string &dicomdir_path, DicomHeaderParser &header_parser);
+
+	// Image files referenced by the loaded DICOMDIR
+	const std::vector<std::string> &file_paths() const { return m_file_paths; }
+
+protected:
+
+private:
+	struct ImageRecord
+	{
+		std::string file_path;
+		std::string sop;
+		unsigned int instance_num;
+		float location;
+	};
+
+	DicomDataMgr *m_data_mgr;
+	int m_thread_num;
+	std::vector<std::string> m_file_paths;
+
+	bool load_series(DcmDirectoryRecord *patient_record, DcmDirectoryRecord *study_record,
+		DcmDirectoryRecord *series_record, const std::string &base_dir, DicomHeaderParser &header_parser);
+
+	static std::string record_string(DcmDirectoryRecord *record, const DcmTagKey &tag);
+	static bool read_image_record(DcmDirectoryRecord *record, const std::string &base_dir, ImageRecord &image);
+	// Reads the missing sop/location from the image file itself
+	static bool read_slice_tags(ImageRecord &image);
+};
@@ -0,0 +1,310 @@
+#ifdef _WIN32
+// windows
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+// local
+#include "DicomDirCrawler.h"
+#include "DicomIndexCache.h"
+// meta
+#include "DicomFolderWatcher.h"
+// Cpp
+#include <vector>
+#include <iostream>
+
+namespace
+{
+	// wake up interval, also the granularity of the settle checks
+	const int gs_poll_ms = 250;
+	// a file is offered once no change event arrived for it this long
+	const int gs_quiet_ms = 300;
+	// unreadable files are dropped after this many offers
+	const int gs_max_attempts = 40;
+}
+
+// public
+DicomFolderWatcher::DicomFolderWatcher() :
+	m_stop(false),
+#ifdef _WIN32
+	m_dir_handle(INVALID_HANDLE_VALUE),
+	m_stop_event(NULL),
+	m_overlapped(new OVERLAPPED()),
+	m_change_buffer(16 * 1024),
+	m_request_pending(false)
+#else
+	m_inotify_fd(-1)
+#endif
+{
+#ifndef _WIN32
+	m_stop_pipe[0] = m_stop_pipe[1] = -1;
+#endif
+}
+
+DicomFolderWatcher::~DicomFolderWatcher()
+{
+	stop();
+#ifdef _WIN32
+	delete (OVERLAPPED *)m_overlapped;
+#endif
+}
+
+bool DicomFolderWatcher::start(const std::string &folder_path, const FileCallback &on_file, const IdleCallback &on_idle)
+{
+	if (m_thread.joinable())
+		return false;
+	m_folder_path = folder_path;
+	if (!m_folder_path.empty() && m_folder_path.back() != '\\' && m_folder_path.back() != '/')
+		m_folder_path += DicomDirCrawler::ms_separator;
+	m_on_file = on_file;
+	m_on_idle = on_idle;
+	m_pending_files.clear();
+	m_done_files.clear();
+	m_stop = false;
+
+	// 1. subscribe before listing, a file landing in between is seen twice at worst
+#ifdef _WIN32
+	m_dir_handle = CreateFileA(folder_path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (m_dir_handle == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Watch folder open failed: " << folder_path << std::endl;
+		return false;
+	}
+	m_stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+	*(OVERLAPPED *)m_overlapped = OVERLAPPED();
+	((OVERLAPPED *)m_overlapped)->hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	m_request_pending = false;
+#else
+	m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotify_fd < 0 || inotify_add_watch(m_inotify_fd, folder_path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+		pipe(m_stop_pipe) != 0)
+	{
+		std::cout << "Watch folder open failed: " << folder_path << std::endl;
+		stop();
+		return false;
+	}
+#endif
+
+	// 2. files already in the spool folder
+	std::vector<DicomCrawlEntry> l_entries;
+	DicomDirCrawler::list(folder_path, false, l_entries);
+	for (int i = 0; i < l_entries.size(); ++i)
+		queue_file(l_entries[i].file_path.substr(m_folder_path.size()));
+
+	m_thread = std::thread(&DicomFolderWatcher::watch_loop, this);
+	return true;
+}
+
+void DicomFolderWatcher::stop()
+{
+	m_stop = true;
+#ifdef _WIN32
+	if (m_stop_event != NULL)
+		SetEvent(m_stop_event);
+#else
+	if (m_stop_pipe[1] >= 0)
+	{
+		char l_byte = 0;
+		if (write(m_stop_pipe[1], &l_byte, 1) < 0)
+			std::cout << "Watch folder stop signal failed" << std::endl;
+	}
+#endif
+	if (m_thread.joinable())
+		m_thread.join();
+
+#ifdef _WIN32
+	OVERLAPPED *l_overlapped = (OVERLAPPED *)m_overlapped;
+	if (m_request_pending)
+	{
+		DWORD l_ignored = 0;
+		CancelIoEx(m_dir_handle, l_overlapped);
+		GetOverlappedResult(m_dir_handle, l_overlapped, &l_ignored, TRUE);
+		m_request_pending = false;
+	}
+	if (m_dir_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_dir_handle);
+	if (m_stop_event != NULL)
+		CloseHandle(m_stop_event);
+	if (l_overlapped->hEvent != NULL)
+		CloseHandle(l_overlapped->hEvent);
+	m_dir_handle = INVALID_HANDLE_VALUE;
+	m_stop_event = NULL;
+	l_overlapped->hEvent = NULL;
+#else
+	if (m_inotify_fd >= 0)
+		close(m_inotify_fd);
+	for (int i = 0; i < 2; ++i)
+	{
+		if (m_stop_pipe[i] >= 0)
+			close(m_stop_pipe[i]);
+		m_stop_pipe[i] = -1;
+	}
+	m_inotify_fd = -1;
+#endif
+}
+
+// protected
+
+// private
+void DicomFolderWatcher::watch_loop()
+{
+	while (!m_stop)
+	{
+		if (!wait_events(gs_poll_ms))
+			break;
+		offer_quiet_files();
+		if (m_on_idle)
+			m_on_idle();
+	}
+}
+
+#ifdef _WIN32
+bool DicomFolderWatcher::wait_events(int timeout_ms)
+{
+	OVERLAPPED *l_overlapped = (OVERLAPPED *)m_overlapped;
+	const DWORD l_buffer_size = (DWORD)(m_change_buffer.size() * sizeof(unsigned long));
+	if (!m_request_pending)
+	{
+		ResetEvent(l_overlapped->hEvent);
+		if (!ReadDirectoryChangesW(m_dir_handle, m_change_buffer.data(), l_buffer_size, FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+			NULL, l_overlapped, NULL))
+		{
+			std::cout << "Watch folder read failed: " << m_folder_path << std::endl;
+			return false;
+		}
+		m_request_pending = true;
+	}
+
+	HANDLE l_handles[2] = { l_overlapped->hEvent, m_stop_event };
+	DWORD l_wait = WaitForMultipleObjects(2, l_handles, FALSE, timeout_ms);
+	if (l_wait == WAIT_OBJECT_0 + 1)
+		return false;
+	if (l_wait != WAIT_OBJECT_0)
+		return true;
+
+	m_request_pending = false;
+	DWORD l_bytes = 0;
+	if (!GetOverlappedResult(m_dir_handle, l_overlapped, &l_bytes, FALSE))
+		return true;
+	if (l_bytes == 0)
+	{
+		// the change buffer overflowed, rescan the folder for anything missed
+		std::vector<DicomCrawlEntry> l_entries;
+		DicomDirCrawler::list(m_folder_path, false, l_entries);
+		for (int i = 0; i < l_entries.size(); ++i)
+			queue_file(l_entries[i].file_path.substr(m_folder_path.size()));
+		return true;
+	}
+	// writes keep reporting MODIFIED, the quiet period in offer_quiet_files waits them out
+	const unsigned char *l_record = (const unsigned char *)m_change_buffer.data();
+	while (true)
+	{
+		const FILE_NOTIFY_INFORMATION *l_info = (const FILE_NOTIFY_INFORMATION *)l_record;
+		if (l_info->Action == FILE_ACTION_ADDED || l_info->Action == FILE_ACTION_MODIFIED ||
+			l_info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+		{
+			int l_length = WideCharToMultiByte(CP_ACP, 0, l_info->FileName, l_info->FileNameLength / sizeof(WCHAR),
+				NULL, 0, NULL, NULL);
+			std::string l_name(l_length, '\0');
+			WideCharToMultiByte(CP_ACP, 0, l_info->FileName, l_info->FileNameLength / sizeof(WCHAR),
+				&l_name[0], l_length, NULL, NULL);
+			DWORD l_attributes = GetFileAttributesA((m_folder_path + l_name).c_str());
+			if (l_attributes != INVALID_FILE_ATTRIBUTES && !(l_attributes & FILE_ATTRIBUTE_DIRECTORY))
+				queue_file(l_name);
+		}
+		if (l_info->NextEntryOffset == 0)
+			break;
+		l_record += l_info->NextEntryOffset;
+	}
+	return true;
+}
+#else
+bool DicomFolderWatcher::wait_events(int timeout_ms)
+{
+	struct pollfd l_fds[2];
+	l_fds[0].fd = m_inotify_fd;
+	l_fds[0].events = POLLIN;
+	l_fds[1].fd = m_stop_pipe[0];
+	l_fds[1].events = POLLIN;
+	if (poll(l_fds, 2, timeout_ms) <= 0)
+		return true;
+	if (l_fds[1].revents & POLLIN)
+		return false;
+
+	// IN_CLOSE_WRITE and IN_MOVED_TO only fire for finished files
+	alignas(struct inotify_event) char l_buffer[64 * 1024];
+	ssize_t l_length;
+	while ((l_length = read(m_inotify_fd, l_buffer, sizeof(l_buffer))) > 0)
+	{
+		for (char *l_ptr = l_buffer; l_ptr < l_buffer + l_length; )
+		{
+			const struct inotify_event *l_event = (const struct inotify_event *)l_ptr;
+			if (l_event->mask & IN_Q_OVERFLOW)
+			{
+				std::vector<DicomCrawlEntry> l_entries;
+				DicomDirCrawler::list(m_folder_path, false, l_entries);
+				for (int i = 0; i < l_entries.size(); ++i)
+					queue_file(l_entries[i].file_path.substr(m_folder_path.size()));
+			}
+			else if (l_event->len > 0 && !(l_event->mask & IN_ISDIR))
+				queue_file(l_event->name);
+			l_ptr += sizeof(struct inotify_event) + l_event->len;
+		}
+	}
+	return true;
+}
+#endif
+
+void DicomFolderWatcher::queue_file(const std::string &file_name)
+{
+	// the DICOMDIR of a media copy is no image
+	if (file_name.empty() || file_name == "DICOMDIR")
+		return;
+	std::string l_path = m_folder_path + file_name;
+	if (m_done_files.count(l_path))
+		return;
+	PendingFile &l_pending = m_pending_files[l_path];
+	l_pending.last_event = Clock::now();
+}
+
+void DicomFolderWatcher::offer_quiet_files()
+{
+	Clock::time_point l_now = Clock::now();
+	for (auto l_iter = m_pending_files.begin(); l_iter != m_pending_files.end() && !m_stop; )
+	{
+		PendingFile &l_pending = l_iter->second;
+		if (std::chrono::duration_cast<std::chrono::milliseconds>(l_now - l_pending.last_event).count() < gs_quiet_ms)
+		{
+			++l_iter;
+			continue;
+		}
+		// a temporary name renamed away before it settled is gone
+		long long l_size, l_mtime;
+		if (!DicomIndexCache::stat_file(l_iter->first, l_size, l_mtime))
+		{
+			l_iter = m_pending_files.erase(l_iter);
+			continue;
+		}
+		if (m_on_file(l_iter->first))
+		{
+			m_done_files.insert(l_iter->first);
+			l_iter = m_pending_files.erase(l_iter);
+		}
+		else if (++l_pending.attempt_num >= gs_max_attempts)
+		{
+			std::cout << "Watch folder gave up on: " << l_iter->first << std::endl;
+			m_done_files.insert(l_iter->first);
+			l_iter = m_pending_files.erase(l_iter);
+		}
+		else
+		{
+			// try again after another quiet period
+			l_pending.last_event = l_now;
+			++l_iter;
+		}
+	}
+}
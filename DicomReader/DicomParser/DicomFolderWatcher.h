@@ -0,0 +1,68 @@
+#pragma once
+// Cpp
+#include <string>
+#include <map>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+/*!
+* \brief Reports files landing in a spool folder
+* Files already in the folder are reported first, then every file created,
+* written or moved into it, ReadDirectoryChangesW on windows and inotify
+* elsewhere. A file is handed out once it has been quiet for a short while;
+* when the callback cannot read it yet it is offered again later, so files
+* still being copied are not lost. Only the folder itself is watched.
+*/
+class DicomFolderWatcher
+{
+public:
+	// Returns false while the file cannot be read yet, it is then retried
+	typedef std::function<bool(const std::string &file_path)> FileCallback;
+	// Called from the watch thread on every wake up, at least once per poll interval
+	typedef std::function<void()> IdleCallback;
+
+	DicomFolderWatcher();
+	~DicomFolderWatcher();
+
+	bool start(const std::string &folder_path, const FileCallback &on_file, const IdleCallback &on_idle);
+	void stop();
+
+protected:
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	struct PendingFile
+	{
+		Clock::time_point last_event;
+		int attempt_num;
+	};
+
+	std::string m_folder_path;
+	FileCallback m_on_file;
+	IdleCallback m_on_idle;
+	std::map<std::string, PendingFile> m_pending_files;
+	std::set<std::string> m_done_files;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+#ifdef _WIN32
+	void *m_dir_handle;
+	void *m_stop_event;
+	// one ReadDirectoryChangesW request (an OVERLAPPED) stays pending between waits
+	void *m_overlapped;
+	std::vector<unsigned long> m_change_buffer;
+	bool m_request_pending;
+#else
+	int m_inotify_fd;
+	int m_stop_pipe[2];
+#endif
+
+	void watch_loop();
+	// Blocks up to timeout_ms for change events and queues their file names
+	bool wait_events(int timeout_ms);
+	void queue_file(const std::string &file_name);
+	void offer_quiet_files();
+};
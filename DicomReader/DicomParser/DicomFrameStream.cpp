@@ -0,0 +1,220 @@
+// dcmtk
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+// local
+#include "DicomCodecRegistry.h"
+// meta
+#include "DicomFrameStream.h"
+// Cpp
+#include <algorithm>
+#include <iostream>
+
+// public
+DicomFrameStream::DicomFrameStream() :
+	m_pixel_data(NULL),
+	m_is_j2k(false),
+	m_frame_num(0),
+	m_frame_bytes(0),
+	m_bits_allocated(0),
+	m_samples_per_pixel(1),
+	m_planar_configuration(0),
+	m_next_frame(-1),
+	m_next_fragment(0),
+	m_window_size(1),
+	m_ahead_first(0),
+	m_ahead_end(0),
+	m_stopped(false)
+{
+}
+
+DicomFrameStream::~DicomFrameStream()
+{
+	close();
+}
+
+bool DicomFrameStream::open(const std::string &file_path, int window_size)
+{
+	close();
+
+	// values longer than the default read length stay on disk, PixelData included
+	if (m_file_format.loadFile(file_path.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength).bad())
+	{
+		std::cerr << "file Load error | " << file_path << std::endl;
+		return false;
+	}
+	DcmDataset *l_dataset = m_file_format.getDataset();
+	DcmElement *l_element = NULL;
+	if (l_dataset->findAndGetElement(DCM_PixelData, l_element).bad() || l_element == NULL)
+	{
+		std::cerr << "No pixel data | " << file_path << std::endl;
+		return false;
+	}
+	m_pixel_data = OFstatic_cast(DcmPixelData *, l_element);
+
+	Uint16 l_rows = 0, l_columns = 0, l_bits_allocated = 0, l_samples_per_pixel = 1, l_planar_configuration = 0;
+	Sint32 l_frame_count = 1;
+	l_dataset->findAndGetUint16(DCM_Rows, l_rows);
+	l_dataset->findAndGetUint16(DCM_Columns, l_columns);
+	l_dataset->findAndGetUint16(DCM_BitsAllocated, l_bits_allocated);
+	l_dataset->findAndGetUint16(DCM_SamplesPerPixel, l_samples_per_pixel);
+	l_dataset->findAndGetUint16(DCM_PlanarConfiguration, l_planar_configuration);
+	l_dataset->findAndGetSint32(DCM_NumberOfFrames, l_frame_count);
+	m_frame_num = std::max((int)l_frame_count, 1);
+	m_bits_allocated = l_bits_allocated;
+	m_samples_per_pixel = l_samples_per_pixel;
+	m_planar_configuration = l_planar_configuration;
+	m_frame_bytes = (size_t)l_rows * l_columns * l_samples_per_pixel * (l_bits_allocated / 8);
+	if (m_frame_bytes == 0)
+		return false;
+
+	m_is_j2k = DicomJ2kDecoder::is_j2k(l_dataset->getOriginalXfer());
+	if (m_is_j2k && !m_j2k_decoder.open(l_dataset, m_frame_num, false))
+	{
+		std::cerr << "Failed to locate the JPEG 2000 frames | " << file_path << std::endl;
+		return false;
+	}
+	if (!m_is_j2k && DcmXfer(l_dataset->getOriginalXfer()).isEncapsulated())
+		DicomCodecRegistry::register_codecs();
+
+	m_window_size = std::max(window_size, 1);
+	m_stopped = false;
+	m_ahead_thread = std::thread(&DicomFrameStream::read_ahead_loop, this);
+	return true;
+}
+
+void DicomFrameStream::close()
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_stopped = true;
+	}
+	m_ahead_cv.notify_all();
+	if (m_ahead_thread.joinable())
+		m_ahead_thread.join();
+
+	m_window.clear();
+	m_frame_to_entry.clear();
+	m_ahead_first = m_ahead_end = 0;
+	m_pixel_data = NULL;
+	m_frame_num = 0;
+	m_next_frame = -1;
+	m_next_fragment = 0;
+	m_file_format.clear();
+}
+
+std::shared_ptr<const DicomFrameStream::Frame> DicomFrameStream::frame(int frame_idx)
+{
+	if (frame_idx < 0 || frame_idx >= m_frame_num)
+		return NULL;
+	std::shared_ptr<const Frame> l_frame = find(frame_idx);
+	return l_frame ? l_frame : load(frame_idx);
+}
+
+void DicomFrameStream::prefetch(int first_frame, int frame_count)
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_ahead_first = std::max(first_frame, 0);
+		m_ahead_end = std::min(m_ahead_first + std::min(frame_count, m_window_size - 1), m_frame_num);
+	}
+	m_ahead_cv.notify_all();
+}
+
+// protected
+
+// private
+void DicomFrameStream::read_ahead_loop()
+{
+	std::unique_lock<std::mutex> l_lock(m_mutex);
+	while (!m_stopped)
+	{
+		int l_frame_idx = -1;
+		for (int k = m_ahead_first; k < m_ahead_end && l_frame_idx < 0; ++k)
+			if (m_frame_to_entry.find(k) == m_frame_to_entry.end())
+				l_frame_idx = k;
+		if (l_frame_idx < 0)
+		{
+			m_ahead_cv.wait(l_lock);
+			continue;
+		}
+		l_lock.unlock();
+		// a frame that fails is left out of the range, the caller reports it
+		if (!load(l_frame_idx))
+		{
+			l_lock.lock();
+			if (m_ahead_first <= l_frame_idx)
+				m_ahead_first = l_frame_idx + 1;
+			continue;
+		}
+		l_lock.lock();
+	}
+}
+
+std::shared_ptr<const DicomFrameStream::Frame> DicomFrameStream::load(int frame_idx)
+{
+	std::lock_guard<std::mutex> l_read_lock(m_read_mutex);
+	// read ahead may have decoded it while this thread waited
+	std::shared_ptr<const Frame> l_cached = find(frame_idx);
+	if (l_cached)
+		return l_cached;
+
+	std::shared_ptr<Frame> l_frame = std::make_shared<Frame>();
+	if (!decode(frame_idx, *l_frame))
+	{
+		std::cerr << "Failed to decode frame " << frame_idx << " of " << m_frame_num << std::endl;
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_window.push_front(WindowEntry(frame_idx, l_frame));
+	m_frame_to_entry[frame_idx] = m_window.begin();
+	while ((int)m_window.size() > m_window_size)
+	{
+		m_frame_to_entry.erase(m_window.back().first);
+		m_window.pop_back();
+	}
+	return l_frame;
+}
+
+std::shared_ptr<const DicomFrameStream::Frame> DicomFrameStream::find(int frame_idx)
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	auto l_iter = m_frame_to_entry.find(frame_idx);
+	if (l_iter == m_frame_to_entry.end())
+		return NULL;
+	m_window.splice(m_window.begin(), m_window, l_iter->second);
+	return l_iter->second->second;
+}
+
+bool DicomFrameStream::decode(int frame_idx, Frame &frame)
+{
+	frame.planar_configuration = m_planar_configuration;
+	if (m_is_j2k)
+	{
+		frame.bytes.resize(m_frame_bytes);
+		return m_j2k_decoder.decode_frame(frame_idx, frame.bytes.data(), m_frame_bytes,
+			m_bits_allocated, m_samples_per_pixel, m_planar_configuration, &m_file_cache);
+	}
+
+	// native frames are a partial read of PixelData, compressed ones read only
+	// their own fragments; the hint carries the fragment position to the next frame
+	frame.bytes.resize(m_frame_bytes + 1);
+	Uint32 l_start_fragment = frame_idx == m_next_frame ? m_next_fragment : 0;
+	OFString l_color_model;
+	DcmDataset *l_dataset = m_file_format.getDataset();
+	if (m_pixel_data->getUncompressedFrame(l_dataset, frame_idx, l_start_fragment, frame.bytes.data(),
+		(Uint32)frame.bytes.size(), l_color_model, &m_file_cache).bad())
+	{
+		m_next_frame = -1;
+		return false;
+	}
+	m_next_frame = frame_idx + 1;
+	m_next_fragment = l_start_fragment;
+	frame.bytes.resize(m_frame_bytes);
+	Uint16 l_frame_planar = (Uint16)m_planar_configuration;
+	l_dataset->findAndGetUint16(DCM_PlanarConfiguration, l_frame_planar);
+	frame.planar_configuration = l_frame_planar;
+	return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+// dcmtk
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcfcache.h>
+// local
+#include "DicomJ2kDecoder.h"
+class DcmPixelData;
+// Cpp
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*!
+* \brief Frame by frame reader for multi frame files too large to load
+* Only the header is parsed, PixelData stays on disk: native frames are read
+* with dcmtk partial value access, compressed ones fragment by fragment
+* through getUncompressedFrame, JPEG 2000 through DicomJ2kDecoder with its
+* fragments left unloaded. Decoded frames are kept in a window of the most
+* recently used ones, a read ahead thread fills it in front of playback, so
+* memory stays at window_size frames whatever the file size.
+*/
+class DicomFrameStream
+{
+public:
+	// One decoded frame in the native layout (BitsAllocated wide samples)
+	struct Frame
+	{
+		std::vector<unsigned char> bytes;
+		// codecs may hand back color frames in another planar configuration
+		int planar_configuration;
+	};
+
+	DicomFrameStream();
+	~DicomFrameStream();
+
+	bool open(const std::string &file_path, int window_size);
+	void close();
+
+	// Header of the opened file, the pixel module is read from it
+	DcmDataset *dataset() { return m_file_format.getDataset(); }
+	int frame_num() const { return m_frame_num; }
+
+	/*!
+	* \brief Frame frame_idx, decoded now unless it is in the window
+	* NULL when it can not be decoded. The frame stays valid after it leaves the window.
+	*/
+	std::shared_ptr<const Frame> frame(int frame_idx);
+	// Decode frames [first_frame, first_frame + frame_count) in the background,
+	// capped to window_size - 1 frames so the frame on screen is not evicted
+	void prefetch(int first_frame, int frame_count);
+
+protected:
+
+private:
+	DcmFileFormat m_file_format;
+	DcmPixelData *m_pixel_data;
+	DcmFileCache m_file_cache;
+	DicomJ2kDecoder m_j2k_decoder;
+	bool m_is_j2k;
+	int m_frame_num;
+	size_t m_frame_bytes;
+	int m_bits_allocated;
+	int m_samples_per_pixel;
+	int m_planar_configuration;
+	// fragment hint of getUncompressedFrame, valid for m_next_frame only
+	int m_next_frame;
+	Uint32 m_next_fragment;
+	// the dataset and file cache serve one decode at a time
+	std::mutex m_read_mutex;
+
+	// decoded frames, most recently used first
+	typedef std::pair<int, std::shared_ptr<const Frame> > WindowEntry;
+	std::list<WindowEntry> m_window;
+	std::unordered_map<int, std::list<WindowEntry>::iterator> m_frame_to_entry;
+	int m_window_size;
+	int m_ahead_first;
+	int m_ahead_end;
+	bool m_stopped;
+	std::mutex m_mutex;
+	std::condition_variable m_ahead_cv;
+	std::thread m_ahead_thread;
+
+	void read_ahead_loop();
+	std::shared_ptr<const Frame> load(int frame_idx);
+	std::shared_ptr<const Frame> find(int frame_idx);
+	bool decode(int frame_idx, Frame &frame);
+};
@@ -12,7 +12,10 @@
 
 /*#include "../DICOMReader/DcmHandler.h"*/
 // public
-DicomHeaderParser::DicomHeaderParser()
+DicomHeaderParser::DicomHeaderParser(DicomDataMgr *data_mgr) :
+	m_data_mgr(data_mgr),
+	m_header_only(false),
+	m_profile(PROFILE_FULL)
 {
 	
 }
@@ -46,7 +49,7 @@ std::vector<std::string> split(const  std::string& s, const std::string& delim)
 //bool DicomHeaderParser::parse_header_info(std::string &file_path, QByteArray* data_array)
 bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat* file_format)
 {
-    DicomDataMgr *l_data_mgr = DicomDataMgr::get_instance();
+    DicomDataMgr *l_data_mgr = m_data_mgr != NULL ? m_data_mgr : DicomDataMgr::get_instance();
     DcmFileFormat l_file_format;
     OFCondition l_status;
     /*DcmHandler handler(&l_file_format);*/
@@ -59,7 +62,11 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
     //    return false;
     if (!file_format) {
         /*l_status = handler.loadDicomFile(file_path.c_str());*/
-		l_status = l_file_format.loadFile(file_path.c_str());
+		if (m_header_only)
+			l_status = l_file_format.loadFileUntilTag(file_path.c_str(), EXS_Unknown, EGL_noChange,
+				DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+		else
+			l_status = l_file_format.loadFile(file_path.c_str());
         if (l_status.bad())
             return false;
     } else {
@@ -97,24 +104,8 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		DicomPatientData *l_new_patient = new DicomPatientData();
 		l_new_patient->m_patient_ID = l_patient_ID;
 
-		l_status = l_dataset->findAndGetOFStringArray(DCM_PatientName, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_name = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFString(DCM_PatientSex, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_gender = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_PatientBirthDate, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_birthday = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_PatientAge, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_age = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_PatientPosition, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_position = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_PatientOrientation, l_tmp_str);
-		if (l_status.good())
-			l_new_patient->m_patient_orientation = l_tmp_str.data();
+		if (m_profile == PROFILE_FULL)
+			read_patient_details(l_dataset, l_new_patient);
 
 		/*DicomPatientPlateImage *l_patient_plate_image = new DicomPatientPlateImage(l_new_patient->m_patient_name.c_str(), l_new_patient->m_patient_birthday.c_str());
 		l_new_patient->m_patient_plate_image = l_patient_plate_image;*/
@@ -135,15 +126,8 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		DicomStudyData *l_new_study = new DicomStudyData();
 		l_new_study->m_study_ID = l_study_ID;
 
-		l_status = l_dataset->findAndGetOFStringArray(DCM_StudyDate, l_tmp_str);
-		if (l_status.good())
-			l_new_study->m_study_date = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_StudyTime, l_tmp_str);
-		if (l_status.good())
-			l_new_study->m_study_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_StudyDescription, l_tmp_str);
-		if (l_status.good())
-			l_new_study->m_study_description = l_tmp_str.data();
+		if (m_profile == PROFILE_FULL)
+			read_study_details(l_dataset, l_new_study);
 
 		l_study_idx = l_data_mgr->append_study(l_patient_idx, l_new_study);
 	}
@@ -164,30 +148,12 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		l_new_series->m_series_number = l_series_number;
 
 		// Ϣ
-		l_status = l_dataset->findAndGetOFString(DCM_ContentTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_content_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_SeriesTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_series_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_SeriesDate, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_series_date = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_Modality, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_series_modality = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_SeriesDescription, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_series_description = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_BodyPartExamined, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_body_part_examined = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_InstitutionName, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_institution_name = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_Manufacturer, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_manufactureer_name = l_tmp_str.data();
 
 		// ݸʽϢ
 		l_status = l_dataset->findAndGetOFString(DCM_Rows, l_tmp_str);
@@ -217,18 +183,6 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		else
 			l_new_series->m_rescale_slope = 1.0f;
 
-		//СCTֵ
-		l_status = l_dataset->findAndGetOFString(DCM_SmallestImagePixelValue, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_smallest_image_pixel_value = ofstr_to_float(l_tmp_str);
-		else
-			l_new_series->m_smallest_image_pixel_value = -1;
-		l_status = l_dataset->findAndGetOFString(DCM_LargestImagePixelValue, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_largest_image_pixel_value = ofstr_to_float(l_tmp_str);
-		else
-			l_new_series->m_largest_image_pixel_value = -1;
-
 		// λ
 		l_status = l_dataset->findAndGetOFString(DCM_WindowCenter, l_tmp_str);
 		if (l_status.good())
@@ -254,9 +208,6 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		}
 
 		// Ϣ
-		l_status = l_dataset->findAndGetOFStringArray(DCM_MediaStorageSOPInstanceUID, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_media_storage_SOP_instance_ID = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_ImagePositionPatient, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_image_position_patient = l_tmp_str.data();
@@ -271,12 +222,6 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		l_status = l_dataset->findAndGetOFStringArray(DCM_SeriesInstanceUID, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_series_instance_ID = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_MediaStorageSOPClassUID, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_media_storage_SOP_class_UID = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_AcquisitionTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_acquisition_time = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_SamplesPerPixel, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_samples_per_pixel = l_tmp_str.data();
@@ -291,9 +236,6 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 			l_new_series->m_study_instance_UID = "bad";
 			return false;
 		}
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ImageType, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_image_type = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_PixelRepresentation, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_pixel_representation = l_tmp_str.data();
@@ -340,85 +282,6 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 			l_new_series->m_series_slice_thickness = ofstr_to_float(l_tmp_str);
 		}
 
-		l_status = l_dataset->findAndGetOFString(DCM_KVP, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_KVP = ofstr_to_float(l_tmp_str);
-
-		l_status = l_dataset->findAndGetOFString(DCM_XRayTubeCurrent, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_KVI = ofstr_to_float(l_tmp_str);
-		else
-			l_new_series->m_KVI = 0;
-
-        l_status = l_dataset->findAndGetOFStringArray(DCM_RETIRED_ModifiedImageDate, l_tmp_str);
-		//l_status = l_dataset->findAndGetOFStringArray(DCM_ACR_NEMA_ModifiedImageDate, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_image_data = l_tmp_str.data();
-        l_status = l_dataset->findAndGetOFStringArray(DCM_RETIRED_ModifiedImageTime, l_tmp_str);
-		//l_status = l_dataset->findAndGetOFStringArray(DCM_ACR_NEMA_ModifiedImageTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_image_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_InstitutionAddress, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_institution_address = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_StationName, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_station_name = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_InstitutionalDepartmentName, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_institutional_department_name = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ManufacturerModelName, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_manufactureer_model_name = l_tmp_str.data();
-
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ReferencedImageSequence, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_referenced_image_sequence = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ContrastBolusAgent, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_contrast_bolus_agent = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ScanOptions, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_scan_options = l_tmp_str.data();
-
-		l_status = l_dataset->findAndGetOFStringArray(DCM_RepetitionTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_repetition_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_EchoTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_echo_time = l_tmp_str.data();
-
-		l_status = l_dataset->findAndGetOFStringArray(DCM_SpacingBetweenSlices, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_spacing_between_slices = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_DataCollectionDiameter, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_data_collection_diameter = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_SoftwareVersions, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_software_versions = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ProtocolName, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_protocol_name = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ReconstructionDiameter, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_reconstruction_diameter = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_GantryDetectorTilt, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_gantry_detector_tilt = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_TableHeight, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_table_height = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_RotationDirection, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_rotation_direction = l_tmp_str.data();
-
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ExposureTime, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_exposure_time = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_XRayTubeCurrent, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_XRay_tube_current = l_tmp_str.data();
 		l_status = l_dataset->findAndGetOFStringArray(DCM_PlanarConfiguration, l_tmp_str);
 		if (l_status.good())
 			l_new_series->m_planar_configuration = l_tmp_str.data();
@@ -452,15 +315,8 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 		else
 			l_new_series->m_overlay_origin = "notoverlay";
 
-		l_status = l_dataset->findAndGetOFStringArray(DCM_Exposure, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_exposure = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_ConvolutionKernel, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_convolution_kernel = l_tmp_str.data();
-		l_status = l_dataset->findAndGetOFStringArray(DCM_AccessionNumber, l_tmp_str);
-		if (l_status.good())
-			l_new_series->m_accession_number = l_tmp_str.data();
+		if (m_profile == PROFILE_FULL)
+			read_series_details(l_dataset, l_new_series);
 
 		l_series_idx = l_data_mgr->append_series(l_patient_idx, l_study_idx, l_new_series);
 
@@ -552,7 +408,217 @@ bool DicomHeaderParser::parse_header_info(std::string file_path, DcmFileFormat*
 	
 }
 
-// protected
+bool DicomHeaderParser::load_details(DicomPatientData *patient, DicomStudyData *study, DicomSeriesData *series)
+{
+	static std::mutex ls_details_mutex;
+	std::lock_guard<std::mutex> l_details_lock(ls_details_mutex);
+	if (patient->m_details_loaded && study->m_details_loaded && series->m_details_loaded)
+		return true;
+
+	std::string l_file_path;
+	series->m_image_file_lock.lock_shared();
+	if (!series->m_image_files.empty())
+		l_file_path = series->m_image_files[0];
+	series->m_image_file_lock.unlock_shared();
+	if (l_file_path.empty())
+		return false;
+
+	// Ϣ֮ǰ
+	DcmFileFormat l_file_format;
+	OFCondition l_status = l_file_format.loadFileUntilTag(l_file_path.c_str(), EXS_Unknown, EGL_noChange,
+		DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+	if (l_status.bad())
+	{
+		std::cout << "load details failed: " << l_file_path << std::endl;
+		return false;
+	}
+	DcmDataset *l_dataset = l_file_format.getDataset();
+	if (!patient->m_details_loaded)
+		read_patient_details(l_dataset, patient);
+	if (!study->m_details_loaded)
+		read_study_details(l_dataset, study);
+	if (!series->m_details_loaded)
+		read_series_details(l_dataset, series);
+	return true;
+}
 
+// protected
 
 // private
+void DicomHeaderParser::read_patient_details(DcmDataset *dataset, DicomPatientData *patient)
+{
+	OFString l_tmp_str;
+	OFCondition l_status;
+	l_status = dataset->findAndGetOFStringArray(DCM_PatientName, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_name = l_tmp_str.data();
+	l_status = dataset->findAndGetOFString(DCM_PatientSex, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_gender = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_PatientBirthDate, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_birthday = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_PatientAge, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_age = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_PatientPosition, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_position = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_PatientOrientation, l_tmp_str);
+	if (l_status.good())
+		patient->m_patient_orientation = l_tmp_str.data();
+	patient->m_details_loaded = true;
+}
+
+void DicomHeaderParser::read_study_details(DcmDataset *dataset, DicomStudyData *study)
+{
+	OFString l_tmp_str;
+	OFCondition l_status;
+	l_status = dataset->findAndGetOFStringArray(DCM_StudyDate, l_tmp_str);
+	if (l_status.good())
+		study->m_study_date = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_StudyTime, l_tmp_str);
+	if (l_status.good())
+		study->m_study_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_StudyDescription, l_tmp_str);
+	if (l_status.good())
+		study->m_study_description = l_tmp_str.data();
+	study->m_details_loaded = true;
+}
+
+void DicomHeaderParser::read_series_details(DcmDataset *dataset, DicomSeriesData *series)
+{
+	OFString l_tmp_str;
+	OFCondition l_status;
+	l_status = dataset->findAndGetOFString(DCM_ContentTime, l_tmp_str);
+	if (l_status.good())
+		series->m_content_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_SeriesTime, l_tmp_str);
+	if (l_status.good())
+		series->m_series_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_SeriesDate, l_tmp_str);
+	if (l_status.good())
+		series->m_series_date = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_BodyPartExamined, l_tmp_str);
+	if (l_status.good())
+		series->m_body_part_examined = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_InstitutionName, l_tmp_str);
+	if (l_status.good())
+		series->m_institution_name = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_Manufacturer, l_tmp_str);
+	if (l_status.good())
+		series->m_manufactureer_name = l_tmp_str.data();
+	//СCTֵ
+	l_status = dataset->findAndGetOFString(DCM_SmallestImagePixelValue, l_tmp_str);
+	if (l_status.good())
+		series->m_smallest_image_pixel_value = ofstr_to_float(l_tmp_str);
+	else
+		series->m_smallest_image_pixel_value = -1;
+	l_status = dataset->findAndGetOFString(DCM_LargestImagePixelValue, l_tmp_str);
+	if (l_status.good())
+		series->m_largest_image_pixel_value = ofstr_to_float(l_tmp_str);
+	else
+		series->m_largest_image_pixel_value = -1;
+	// Ϣ
+	l_status = dataset->findAndGetOFStringArray(DCM_MediaStorageSOPInstanceUID, l_tmp_str);
+	if (l_status.good())
+		series->m_media_storage_SOP_instance_ID = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_MediaStorageSOPClassUID, l_tmp_str);
+	if (l_status.good())
+		series->m_media_storage_SOP_class_UID = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_AcquisitionTime, l_tmp_str);
+	if (l_status.good())
+		series->m_acquisition_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ImageType, l_tmp_str);
+	if (l_status.good())
+		series->m_image_type = l_tmp_str.data();
+	l_status = dataset->findAndGetOFString(DCM_KVP, l_tmp_str);
+	if (l_status.good())
+		series->m_KVP = ofstr_to_float(l_tmp_str);
+
+	l_status = dataset->findAndGetOFString(DCM_XRayTubeCurrent, l_tmp_str);
+	if (l_status.good())
+		series->m_KVI = ofstr_to_float(l_tmp_str);
+	else
+		series->m_KVI = 0;
+
+        l_status = dataset->findAndGetOFStringArray(DCM_RETIRED_ModifiedImageDate, l_tmp_str);
+	//l_status = dataset->findAndGetOFStringArray(DCM_ACR_NEMA_ModifiedImageDate, l_tmp_str);
+	if (l_status.good())
+		series->m_image_data = l_tmp_str.data();
+        l_status = dataset->findAndGetOFStringArray(DCM_RETIRED_ModifiedImageTime, l_tmp_str);
+	//l_status = dataset->findAndGetOFStringArray(DCM_ACR_NEMA_ModifiedImageTime, l_tmp_str);
+	if (l_status.good())
+		series->m_image_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_InstitutionAddress, l_tmp_str);
+	if (l_status.good())
+		series->m_institution_address = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_StationName, l_tmp_str);
+	if (l_status.good())
+		series->m_station_name = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_InstitutionalDepartmentName, l_tmp_str);
+	if (l_status.good())
+		series->m_institutional_department_name = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ManufacturerModelName, l_tmp_str);
+	if (l_status.good())
+		series->m_manufactureer_model_name = l_tmp_str.data();
+
+	l_status = dataset->findAndGetOFStringArray(DCM_ReferencedImageSequence, l_tmp_str);
+	if (l_status.good())
+		series->m_referenced_image_sequence = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ContrastBolusAgent, l_tmp_str);
+	if (l_status.good())
+		series->m_contrast_bolus_agent = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ScanOptions, l_tmp_str);
+	if (l_status.good())
+		series->m_scan_options = l_tmp_str.data();
+
+	l_status = dataset->findAndGetOFStringArray(DCM_RepetitionTime, l_tmp_str);
+	if (l_status.good())
+		series->m_repetition_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_EchoTime, l_tmp_str);
+	if (l_status.good())
+		series->m_echo_time = l_tmp_str.data();
+
+	l_status = dataset->findAndGetOFStringArray(DCM_SpacingBetweenSlices, l_tmp_str);
+	if (l_status.good())
+		series->m_spacing_between_slices = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_DataCollectionDiameter, l_tmp_str);
+	if (l_status.good())
+		series->m_data_collection_diameter = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_SoftwareVersions, l_tmp_str);
+	if (l_status.good())
+		series->m_software_versions = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ProtocolName, l_tmp_str);
+	if (l_status.good())
+		series->m_protocol_name = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ReconstructionDiameter, l_tmp_str);
+	if (l_status.good())
+		series->m_reconstruction_diameter = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_GantryDetectorTilt, l_tmp_str);
+	if (l_status.good())
+		series->m_gantry_detector_tilt = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_TableHeight, l_tmp_str);
+	if (l_status.good())
+		series->m_table_height = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_RotationDirection, l_tmp_str);
+	if (l_status.good())
+		series->m_rotation_direction = l_tmp_str.data();
+
+	l_status = dataset->findAndGetOFStringArray(DCM_ExposureTime, l_tmp_str);
+	if (l_status.good())
+		series->m_exposure_time = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_XRayTubeCurrent, l_tmp_str);
+	if (l_status.good())
+		series->m_XRay_tube_current = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_Exposure, l_tmp_str);
+	if (l_status.good())
+		series->m_exposure = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_ConvolutionKernel, l_tmp_str);
+	if (l_status.good())
+		series->m_convolution_kernel = l_tmp_str.data();
+	l_status = dataset->findAndGetOFStringArray(DCM_AccessionNumber, l_tmp_str);
+	if (l_status.good())
+		series->m_accession_number = l_tmp_str.data();
+	series->m_details_loaded = true;
+}
@@ -11,12 +11,26 @@
 
 #include "DicomDataMgr.h"
 class DcmFileFormat;
+class DcmDataset;
 
 class DicomHeaderParser/* : public QObject*/
 {
 	/*Q_OBJECT*/
 public:
-	DicomHeaderParser();
+	/*!
+	* \brief ͷϢȡΧ
+	* PROFILE_GEOMETRY ֻȡ齨Ҫıǩ, Ϣ load_details 貹
+	*/
+	enum ExtractProfile
+	{
+		PROFILE_FULL = 0,
+		PROFILE_GEOMETRY
+	};
+
+	/*!
+	* \brief data_mgr ΪͷϢдĿ, NULL ʱʹȫֵ
+	*/
+	DicomHeaderParser(DicomDataMgr *data_mgr = NULL);
 	~DicomHeaderParser();
 	/*!
 	* \brief ȡһdicomļͷϢ¼ؼϢ
@@ -27,9 +41,27 @@ public:
     //bool parse_header_info(std::string &file_path, QByteArray* data_array=NULL);
 	/*bool update_dr_window_cw();*/
 
+	/*!
+	* \brief Stop reading files at the PixelData tag, only the header bytes are read
+	*/
+	void set_header_only(bool header_only) { m_header_only = header_only; }
+	void set_profile(ExtractProfile profile) { m_profile = profile; }
+
+	/*!
+	* \brief еһļģʽĲ//Ϣ
+	*/
+	bool load_details(DicomPatientData *patient, DicomStudyData *study, DicomSeriesData *series);
+
 protected:
 
 private:
+	DicomDataMgr *m_data_mgr;
+	bool m_header_only;
+	ExtractProfile m_profile;
+
+	void read_patient_details(DcmDataset *dataset, DicomPatientData *patient);
+	void read_study_details(DcmDataset *dataset, DicomStudyData *study);
+	void read_series_details(DcmDataset *dataset, DicomSeriesData *series);
 
 	inline unsigned short ofstr_to_uint16(OFString &str)
 	{
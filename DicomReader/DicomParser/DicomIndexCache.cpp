@@ -0,0 +1,382 @@
+#ifdef _WIN32
+// windows
+#include <windows.h>
+#endif
+// Cpp
+#include <sys/stat.h>
+#include <cstdio>
+#include <set>
+#include <algorithm>
+// local
+#include "DicomDataMgr.h"
+#include "DicomPatientData.h"
+#include "DicomStudyData.h"
+#include "DicomSeriesData.h"
+#include "DicomDirCrawler.h"
+// meta
+#include "DicomIndexCache.h"
+
+static const char ms_index_magic[8] = { 'M', 'T', 'K', 'I', 'D', 'X', '0', '3' };
+
+static void write_int(std::ofstream &out, long long value)
+{
+	out.write((const char *)&value, sizeof(value));
+}
+
+static void write_float(std::ofstream &out, float value)
+{
+	out.write((const char *)&value, sizeof(value));
+}
+
+static void write_string(std::ofstream &out, const std::string &value)
+{
+	write_int(out, value.size());
+	out.write(value.data(), value.size());
+}
+
+static long long read_int(std::ifstream &in)
+{
+	long long l_value = 0;
+	in.read((char *)&l_value, sizeof(l_value));
+	return l_value;
+}
+
+static float read_float(std::ifstream &in)
+{
+	float l_value = 0.0f;
+	in.read((char *)&l_value, sizeof(l_value));
+	return l_value;
+}
+
+static std::string read_string(std::ifstream &in)
+{
+	long long l_size = read_int(in);
+	if (!in.good() || l_size < 0 || l_size > 0xFFFFFF)
+	{
+		in.setstate(std::ios::failbit);
+		return std::string();
+	}
+	std::string l_value(l_size, '\0');
+	in.read(&l_value[0], l_size);
+	return l_value;
+}
+
+// public
+DicomIndexCache::DicomIndexCache(std::string cache_dir) :
+	m_cache_dir(cache_dir)
+{
+
+}
+
+DicomIndexCache::~DicomIndexCache()
+{
+
+}
+
+bool DicomIndexCache::restore(std::string &folder_path, std::vector<std::string> &file_paths, DicomDataMgr *data_mgr,
+	bool need_details)
+{
+	std::ifstream l_in(index_file_path(folder_path).c_str(), std::ios::binary);
+	if (!l_in.is_open())
+		return false;
+
+	char l_magic[sizeof(ms_index_magic)];
+	l_in.read(l_magic, sizeof(l_magic));
+	if (!l_in.good() || !std::equal(l_magic, l_magic + sizeof(l_magic), ms_index_magic))
+		return false;
+	if (read_string(l_in) != folder_path)
+		return false;
+
+	// 1. validate the folder, one stat per file
+	long long l_file_num = read_int(l_in);
+	if (!l_in.good() || l_file_num != file_paths.size())
+		return false;
+	std::set<std::string> l_file_set(file_paths.begin(), file_paths.end());
+	for (long long i = 0; i < l_file_num; ++i)
+	{
+		std::string l_file_path = read_string(l_in);
+		long long l_size = read_int(l_in);
+		long long l_mtime = read_int(l_in);
+		long long l_cur_size, l_cur_mtime;
+		if (!l_in.good() || l_file_set.find(l_file_path) == l_file_set.end() ||
+			!stat_file(l_file_path, l_cur_size, l_cur_mtime) ||
+			l_cur_size != l_size || l_cur_mtime != l_mtime)
+			return false;
+	}
+
+	// 2. rebuild the patient/study/series tree
+	long long l_patient_num = read_int(l_in);
+	for (long long i = 0; i < l_patient_num && l_in.good(); ++i)
+	{
+		DicomPatientData *l_patient = new DicomPatientData();
+		l_patient->m_patient_ID = read_string(l_in);
+		l_patient->m_patient_name = read_string(l_in);
+		l_patient->m_patient_gender = read_string(l_in);
+		l_patient->m_patient_birthday = read_string(l_in);
+		l_patient->m_patient_age = read_string(l_in);
+		l_patient->m_patient_position = read_string(l_in);
+		l_patient->m_patient_orientation = read_string(l_in);
+		l_patient->m_details_loaded = read_int(l_in) != 0;
+		int l_patient_idx = data_mgr->append_patient(l_patient);
+
+		long long l_study_num = read_int(l_in);
+		for (long long j = 0; j < l_study_num && l_in.good(); ++j)
+		{
+			DicomStudyData *l_study = new DicomStudyData();
+			l_study->m_study_ID = read_string(l_in);
+			l_study->m_study_date = read_string(l_in);
+			l_study->m_study_time = read_string(l_in);
+			l_study->m_study_description = read_string(l_in);
+			l_study->m_details_loaded = read_int(l_in) != 0;
+			int l_study_idx = data_mgr->append_study(l_patient_idx, l_study);
+
+			long long l_series_num = read_int(l_in);
+			for (long long k = 0; k < l_series_num && l_in.good(); ++k)
+			{
+				DicomSeriesData *l_series = new DicomSeriesData();
+				if (!read_series(l_in, l_series))
+				{
+					delete l_series;
+					break;
+				}
+				data_mgr->append_series(l_patient_idx, l_study_idx, l_series);
+			}
+		}
+	}
+
+	if (!l_in.good())
+	{
+		data_mgr->clear_data();
+		return false;
+	}
+
+	// an index written by a geometry only scan lacks the descriptions a full load expects
+	for (DicomPatientData *l_patient : data_mgr->m_patients)
+	{
+		bool l_complete = l_patient->m_details_loaded;
+		for (DicomStudyData *l_study : l_patient->m_studies)
+		{
+			l_complete = l_complete && l_study->m_details_loaded;
+			for (DicomSeriesData *l_series : l_study->m_series)
+				l_complete = l_complete && l_series->m_details_loaded;
+		}
+		if (need_details && !l_complete)
+		{
+			data_mgr->clear_data();
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DicomIndexCache::store(std::string &folder_path, std::vector<std::string> &file_paths, DicomDataMgr *data_mgr)
+{
+	std::string l_index_path = index_file_path(folder_path);
+	std::string l_tmp_path = l_index_path + ".tmp";
+	std::ofstream l_out(l_tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!l_out.is_open())
+		return false;
+
+	l_out.write(ms_index_magic, sizeof(ms_index_magic));
+	write_string(l_out, folder_path);
+
+	write_int(l_out, file_paths.size());
+	for (int i = 0; i < file_paths.size(); ++i)
+	{
+		long long l_size = -1, l_mtime = -1;
+		stat_file(file_paths[i], l_size, l_mtime);
+		write_string(l_out, file_paths[i]);
+		write_int(l_out, l_size);
+		write_int(l_out, l_mtime);
+	}
+
+	write_int(l_out, data_mgr->m_patients.size());
+	for (int i = 0; i < data_mgr->m_patients.size(); ++i)
+	{
+		DicomPatientData *l_patient = data_mgr->m_patients[i];
+		write_string(l_out, l_patient->m_patient_ID);
+		write_string(l_out, l_patient->m_patient_name);
+		write_string(l_out, l_patient->m_patient_gender);
+		write_string(l_out, l_patient->m_patient_birthday);
+		write_string(l_out, l_patient->m_patient_age);
+		write_string(l_out, l_patient->m_patient_position);
+		write_string(l_out, l_patient->m_patient_orientation);
+		write_int(l_out, l_patient->m_details_loaded);
+
+		write_int(l_out, l_patient->m_studies.size());
+		for (int j = 0; j < l_patient->m_studies.size(); ++j)
+		{
+			DicomStudyData *l_study = l_patient->m_studies[j];
+			write_string(l_out, l_study->m_study_ID);
+			write_string(l_out, l_study->m_study_date);
+			write_string(l_out, l_study->m_study_time);
+			write_string(l_out, l_study->m_study_description);
+			write_int(l_out, l_study->m_details_loaded);
+
+			write_int(l_out, l_study->m_series.size());
+			for (int k = 0; k < l_study->m_series.size(); ++k)
+				write_series(l_out, l_study->m_series[k]);
+		}
+	}
+
+	l_out.close();
+	if (l_out.fail())
+	{
+		std::remove(l_tmp_path.c_str());
+		return false;
+	}
+	std::remove(l_index_path.c_str());
+	return std::rename(l_tmp_path.c_str(), l_index_path.c_str()) == 0;
+}
+
+bool DicomIndexCache::stat_file(const std::string &file_path, long long &size, long long &mtime)
+{
+	// whole seconds miss a file rewritten within the same second at the same size
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA l_attributes;
+	if (!GetFileAttributesExA(file_path.c_str(), GetFileExInfoStandard, &l_attributes))
+		return false;
+	size = ((long long)l_attributes.nFileSizeHigh << 32) | l_attributes.nFileSizeLow;
+	mtime = ((long long)l_attributes.ftLastWriteTime.dwHighDateTime << 32) | l_attributes.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat l_stat;
+	if (stat(file_path.c_str(), &l_stat) != 0)
+		return false;
+	size = l_stat.st_size;
+	mtime = (long long)l_stat.st_mtim.tv_sec * 1000000000LL + l_stat.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+// protected
+
+// private
+std::string DicomIndexCache::index_file_path(std::string &folder_path)
+{
+	// FNV-1a, stable between runs unlike std::hash
+	unsigned long long l_hash = 14695981039346656037ULL;
+	for (int i = 0; i < folder_path.size(); ++i)
+	{
+		l_hash ^= (unsigned char)folder_path[i];
+		l_hash *= 1099511628211ULL;
+	}
+	char l_name[32];
+	snprintf(l_name, sizeof(l_name), "%016llx.mtkidx", l_hash);
+	return m_cache_dir + DicomDirCrawler::ms_separator + l_name;
+}
+
+void DicomIndexCache::write_series(std::ofstream &out, DicomSeriesData *series)
+{
+	write_string(out, series->m_series_number);
+	write_string(out, series->m_series_modality);
+	write_string(out, series->m_series_description);
+	write_string(out, series->m_series_instance_ID);
+	write_string(out, series->m_study_instance_UID);
+	write_string(out, series->m_photo_metric_interpretation);
+	write_string(out, series->m_samples_per_pixel);
+	write_string(out, series->m_planar_configuration);
+	write_string(out, series->m_pixel_representation);
+	write_string(out, series->m_image_position_patient);
+	write_string(out, series->m_image_orientation_patient);
+	write_int(out, series->m_resolution[0]);
+	write_int(out, series->m_resolution[1]);
+	write_int(out, series->m_bits_allocated);
+	write_int(out, series->m_high_bit);
+	write_int(out, series->m_bits_stored);
+	write_int(out, series->m_data_type);
+	write_float(out, series->m_rescale_intercept);
+	write_float(out, series->m_rescale_slope);
+	write_float(out, series->m_window_center);
+	write_float(out, series->m_window_width);
+	write_int(out, series->m_window_center_good);
+	write_int(out, series->m_window_width_good);
+	write_float(out, series->m_pixel_spacing[0]);
+	write_float(out, series->m_pixel_spacing[1]);
+	write_float(out, series->m_series_slice_thickness);
+	write_int(out, series->m_series_slice_thickness_good);
+	write_string(out, series->m_overlay_row);
+	write_string(out, series->m_overlay_column);
+	write_string(out, series->m_overlay_bit_allocated);
+	write_string(out, series->m_overlay_origin);
+	write_int(out, series->m_overlay_row_ori);
+	write_int(out, series->m_overlay_column_ori);
+	write_int(out, series->m_details_loaded);
+
+	// slices in instance order, with the instance number sort_slices settled on
+	series->sort_slices();
+	int l_slice_num = series->slice_num();
+	write_int(out, l_slice_num);
+	for (int i = 0; i < l_slice_num; ++i)
+	{
+		int l_idx = series->sorted_slice(i);
+		write_string(out, series->m_image_files[l_idx]);
+		write_string(out, series->slice_sop(l_idx));
+		write_int(out, series->m_instance_numbers[l_idx]);
+		write_float(out, series->m_locations[l_idx]);
+		write_int(out, series->m_slice_widths[l_idx]);
+		write_int(out, series->m_slice_heights[l_idx]);
+		write_string(out, series->slice_sample(l_idx));
+		write_int(out, series->m_slice_bits_allocated[l_idx]);
+		write_int(out, series->m_slice_planar_configurations[l_idx]);
+		write_string(out, series->slice_overlay(l_idx));
+	}
+}
+
+bool DicomIndexCache::read_series(std::ifstream &in, DicomSeriesData *series)
+{
+	series->m_series_number = read_string(in);
+	series->m_series_modality = read_string(in);
+	series->m_series_description = read_string(in);
+	series->m_series_instance_ID = read_string(in);
+	series->m_study_instance_UID = read_string(in);
+	series->m_photo_metric_interpretation = read_string(in);
+	series->m_samples_per_pixel = read_string(in);
+	series->m_planar_configuration = read_string(in);
+	series->m_pixel_representation = read_string(in);
+	series->m_image_position_patient = read_string(in);
+	series->m_image_orientation_patient = read_string(in);
+	series->m_resolution[0] = read_int(in);
+	series->m_resolution[1] = read_int(in);
+	series->m_bits_allocated = read_int(in);
+	series->m_high_bit = read_int(in);
+	series->m_bits_stored = read_int(in);
+	series->m_data_type = read_int(in);
+	series->m_rescale_intercept = read_float(in);
+	series->m_rescale_slope = read_float(in);
+	series->m_window_center = read_float(in);
+	series->m_window_width = read_float(in);
+	series->m_window_center_good = read_int(in) != 0;
+	series->m_window_width_good = read_int(in) != 0;
+	series->m_pixel_spacing[0] = read_float(in);
+	series->m_pixel_spacing[1] = read_float(in);
+	series->m_series_slice_thickness = read_float(in);
+	series->m_series_slice_thickness_good = read_int(in) != 0;
+	series->m_overlay_row = read_string(in);
+	series->m_overlay_column = read_string(in);
+	series->m_overlay_bit_allocated = read_string(in);
+	series->m_overlay_origin = read_string(in);
+	series->m_overlay_row_ori = read_int(in);
+	series->m_overlay_column_ori = read_int(in);
+	series->m_details_loaded = read_int(in) != 0;
+
+	long long l_slice_num = read_int(in);
+	for (int i = 0; i < l_slice_num && in.good(); ++i)
+	{
+		std::string l_file_path = read_string(in);
+		std::string l_sop = read_string(in);
+		unsigned int l_instance_num = read_int(in);
+		float l_location = read_float(in);
+
+		int l_width = read_int(in);
+		int l_height = read_int(in);
+		std::string l_sample = read_string(in);
+		int l_bit_allocate = read_int(in);
+		int l_planar_configuration = read_int(in);
+		std::string l_overlay = read_string(in);
+		series->append_slice_record(l_sop, l_instance_num, l_location, l_width, l_height, l_sample,
+			l_bit_allocate, l_planar_configuration, l_overlay, l_file_path, NULL);
+	}
+	series->sort_slices();
+	series->m_series_plate_dirty = true;
+	return in.good();
+}
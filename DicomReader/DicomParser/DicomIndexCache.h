@@ -0,0 +1,46 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <fstream>
+// local
+class DicomDataMgr;
+class DicomSeriesData;
+
+/*!
+* \brief On-disk index of parsed dicom folders
+* Keeps the patient/study/series tree built by DicomHeaderParser keyed by the
+* path, size and mtime of every file, so an unchanged folder can be reopened
+* without parsing any header.
+*/
+class DicomIndexCache
+{
+public:
+	DicomIndexCache(std::string cache_dir);
+	~DicomIndexCache();
+
+	/*!
+	* \brief Rebuild the tree of folder_path in data_mgr from its index
+	* Fails when there is no index or any file was added, removed or changed,
+	* and with need_details when the index came from a geometry only scan.
+	*/
+	bool restore(std::string &folder_path, std::vector<std::string> &file_paths, DicomDataMgr *data_mgr,
+		bool need_details);
+	/*!
+	* \brief Write the tree parsed from file_paths as the index of folder_path
+	*/
+	bool store(std::string &folder_path, std::vector<std::string> &file_paths, DicomDataMgr *data_mgr);
+
+	// mtime in the finest unit the platform keeps: 100 ns ticks on Windows, ns elsewhere
+	static bool stat_file(const std::string &file_path, long long &size, long long &mtime);
+
+protected:
+
+private:
+	std::string m_cache_dir;
+
+	std::string index_file_path(std::string &folder_path);
+
+	void write_series(std::ofstream &out, DicomSeriesData *series);
+	bool read_series(std::ifstream &in, DicomSeriesData *series);
+};
@@ -0,0 +1,152 @@
+#ifdef _WIN32
+// windows
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+#endif
+// Cpp
+#include <cstring>
+#include <vector>
+// meta
+#include "DicomIoScheduler.h"
+
+// keys of files with no extent, e.g. small files resident in the NTFS MFT
+#define DCM_NO_EXTENT_KEY (1ULL << 63)
+
+// public
+unsigned long long DicomIoScheduler::physical_key(const std::string &file_path)
+{
+#ifdef _WIN32
+	HANDLE l_file = CreateFileA(file_path.c_str(), FILE_READ_ATTRIBUTES,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (l_file == INVALID_HANDLE_VALUE)
+		return ~0ULL;
+
+	unsigned long long l_key = ~0ULL;
+	STARTING_VCN_INPUT_BUFFER l_vcn_input;
+	l_vcn_input.StartingVcn.QuadPart = 0;
+	RETRIEVAL_POINTERS_BUFFER l_extents;
+	DWORD l_bytes = 0;
+	// one extent is enough, ERROR_MORE_DATA only says there are more
+	BOOL l_ok = DeviceIoControl(l_file, FSCTL_GET_RETRIEVAL_POINTERS, &l_vcn_input, sizeof(l_vcn_input),
+		&l_extents, sizeof(l_extents), &l_bytes, NULL);
+	if ((l_ok || GetLastError() == ERROR_MORE_DATA) && l_extents.ExtentCount > 0 && l_extents.Extents[0].Lcn.QuadPart >= 0)
+	{
+		l_key = (unsigned long long)l_extents.Extents[0].Lcn.QuadPart;
+	}
+	else
+	{
+		BY_HANDLE_FILE_INFORMATION l_info;
+		if (GetFileInformationByHandle(l_file, &l_info))
+			l_key = DCM_NO_EXTENT_KEY | ((unsigned long long)l_info.nFileIndexHigh << 32) | l_info.nFileIndexLow;
+	}
+	CloseHandle(l_file);
+	return l_key;
+#else
+	int l_fd = open(file_path.c_str(), O_RDONLY);
+	if (l_fd < 0)
+		return ~0ULL;
+
+	unsigned long long l_key = ~0ULL;
+#ifdef __linux__
+	// fiemap header followed by room for one extent
+	unsigned long long l_fiemap_buf[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(unsigned long long) + 1];
+	memset(l_fiemap_buf, 0, sizeof(l_fiemap_buf));
+	struct fiemap *l_fiemap = (struct fiemap *)l_fiemap_buf;
+	l_fiemap->fm_start = 0;
+	l_fiemap->fm_length = ~0ULL;
+	l_fiemap->fm_extent_count = 1;
+	if (ioctl(l_fd, FS_IOC_FIEMAP, l_fiemap) == 0 && l_fiemap->fm_mapped_extents > 0)
+		l_key = l_fiemap->fm_extents[0].fe_physical;
+#endif
+	struct stat l_stat;
+	if (l_key == ~0ULL && fstat(l_fd, &l_stat) == 0)
+		l_key = DCM_NO_EXTENT_KEY | (unsigned long long)l_stat.st_ino;
+	::close(l_fd);
+	return l_key;
+#endif
+}
+
+DicomIoScheduler::DicomIoScheduler(const std::vector<std::string> &file_paths, int window) :
+	m_file_paths(file_paths),
+	m_window(window),
+	m_consumed_num(0),
+	m_stopped(false)
+{
+	if (m_window > 0 && !m_file_paths.empty())
+		m_thread = std::thread(&DicomIoScheduler::run, this);
+}
+
+DicomIoScheduler::~DicomIoScheduler()
+{
+	stop();
+}
+
+void DicomIoScheduler::advance()
+{
+	{
+		// the readahead thread tests the count under m_mutex, a bare increment could lose its wakeup
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_consumed_num.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_cv.notify_one();
+}
+
+void DicomIoScheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_stopped = true;
+	}
+	m_cv.notify_one();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+// protected
+
+// private
+void DicomIoScheduler::run()
+{
+	int l_file_num = m_file_paths.size();
+	for (int i = 0; i < l_file_num; ++i)
+	{
+		{
+			std::unique_lock<std::mutex> l_lock(m_mutex);
+			m_cv.wait(l_lock, [&]() { return m_stopped || i < m_consumed_num + m_window; });
+		}
+		if (m_stopped)
+			return;
+		readahead(m_file_paths[i]);
+	}
+}
+
+void DicomIoScheduler::readahead(const std::string &file_path)
+{
+#ifdef _WIN32
+	// no fadvise on windows, a sequential read pulls the file into the standby cache
+	HANDLE l_file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (l_file == INVALID_HANDLE_VALUE)
+		return;
+	static thread_local std::vector<char> tl_scratch(1 << 20);
+	DWORD l_read = 0;
+	while (ReadFile(l_file, tl_scratch.data(), (DWORD)tl_scratch.size(), &l_read, NULL) && l_read > 0)
+		;
+	CloseHandle(l_file);
+#else
+	int l_fd = open(file_path.c_str(), O_RDONLY);
+	if (l_fd < 0)
+		return;
+	posix_fadvise(l_fd, 0, 0, POSIX_FADV_WILLNEED);
+	::close(l_fd);
+#endif
+}
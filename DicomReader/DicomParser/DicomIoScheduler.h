@@ -0,0 +1,46 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*!
+* \brief Read ordering and readahead for the slice decode stage
+* physical_order sorts files by where their data sits on the volume (first
+* extent, else the file index/inode) so a pass over a spinning disk or NFS
+* export reads forward instead of seeking. A readahead thread keeps the next
+* window of files in the OS cache ahead of the decoders.
+*/
+class DicomIoScheduler
+{
+public:
+	/*!
+	* \brief Sort key of a file's on-disk position, files without a mapped
+	* extent sort after the extent keyed ones by file index/inode
+	*/
+	static unsigned long long physical_key(const std::string &file_path);
+
+	DicomIoScheduler(const std::vector<std::string> &file_paths, int window);
+	~DicomIoScheduler();
+
+	// Decoders call this once per file taken from file_paths, in any order
+	void advance();
+	void stop();
+
+protected:
+
+private:
+	std::vector<std::string> m_file_paths;
+	int m_window;
+	std::atomic<int> m_consumed_num;
+	std::atomic<bool> m_stopped;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+
+	void run();
+	static void readahead(const std::string &file_path);
+};
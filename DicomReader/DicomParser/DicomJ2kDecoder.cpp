@@ -0,0 +1,283 @@
+// dcmtk
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcpixseq.h>
+#include <dcmtk/dcmdata/dcpxitem.h>
+// openjpeg
+#include <openjpeg.h>
+// meta
+#include "DicomJ2kDecoder.h"
+// Cpp
+#include <omp.h>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	// OpenJPEG input stream over one codestream in memory
+	struct J2kMemoryStream
+	{
+		const unsigned char *data;
+		size_t length;
+		size_t offset;
+	};
+
+	OPJ_SIZE_T j2k_stream_read(void *buffer, OPJ_SIZE_T byte_num, void *user_data)
+	{
+		J2kMemoryStream *l_stream = (J2kMemoryStream *)user_data;
+		if (l_stream->offset >= l_stream->length)
+			return (OPJ_SIZE_T)-1;
+		OPJ_SIZE_T l_read_num = std::min<OPJ_SIZE_T>(byte_num, l_stream->length - l_stream->offset);
+		memcpy(buffer, l_stream->data + l_stream->offset, l_read_num);
+		l_stream->offset += l_read_num;
+		return l_read_num;
+	}
+
+	OPJ_OFF_T j2k_stream_skip(OPJ_OFF_T byte_num, void *user_data)
+	{
+		J2kMemoryStream *l_stream = (J2kMemoryStream *)user_data;
+		OPJ_OFF_T l_target = std::max<OPJ_OFF_T>(0, std::min<OPJ_OFF_T>((OPJ_OFF_T)l_stream->offset + byte_num, (OPJ_OFF_T)l_stream->length));
+		OPJ_OFF_T l_skipped = l_target - (OPJ_OFF_T)l_stream->offset;
+		l_stream->offset = (size_t)l_target;
+		return l_skipped;
+	}
+
+	OPJ_BOOL j2k_stream_seek(OPJ_OFF_T offset, void *user_data)
+	{
+		J2kMemoryStream *l_stream = (J2kMemoryStream *)user_data;
+		if (offset < 0 || (size_t)offset > l_stream->length)
+			return OPJ_FALSE;
+		l_stream->offset = (size_t)offset;
+		return OPJ_TRUE;
+	}
+
+	// the codestream begins with the SOC marker, a JP2 file wraps it in boxes
+	bool is_codestream_start(const unsigned char *data, size_t length)
+	{
+		return length >= 2 && data[0] == 0xFF && data[1] == 0x4F;
+	}
+}
+
+// public
+DicomJ2kDecoder::DicomJ2kDecoder()
+{
+}
+
+DicomJ2kDecoder::~DicomJ2kDecoder()
+{
+}
+
+bool DicomJ2kDecoder::is_j2k(E_TransferSyntax xfer)
+{
+	return xfer == EXS_JPEG2000LosslessOnly || xfer == EXS_JPEG2000;
+}
+
+bool DicomJ2kDecoder::open(DcmDataset *dataset, int frame_num, bool load_fragments)
+{
+	m_fragments.clear();
+	m_frames.clear();
+
+	DcmElement *l_element = NULL;
+	if (dataset->findAndGetElement(DCM_PixelData, l_element).bad() || l_element == NULL)
+		return false;
+	DcmPixelData *l_pixel_data = OFstatic_cast(DcmPixelData *, l_element);
+	E_TransferSyntax l_xfer = EXS_Unknown;
+	const DcmRepresentationParameter *l_rep = NULL;
+	l_pixel_data->getOriginalRepresentationKey(l_xfer, l_rep);
+	DcmPixelSequence *l_sequence = NULL;
+	if (l_pixel_data->getEncapsulatedRepresentation(l_xfer, l_rep, l_sequence).bad() || l_sequence == NULL)
+		return false;
+
+	// item 0 is the basic offset table, the fragments follow. getUint8Array
+	// loads the value, so it runs here once and never in decode_frame. The
+	// offset table is small and always loaded.
+	const unsigned long l_item_num = l_sequence->card();
+	const unsigned char *l_table = NULL;
+	size_t l_table_length = 0;
+	for (unsigned long i = 0; i < l_item_num; ++i)
+	{
+		DcmPixelItem *l_item = NULL;
+		Uint8 *l_data = NULL;
+		if (l_sequence->getItem(l_item, i).bad() || l_item == NULL)
+			return false;
+		size_t l_length = l_item->getLength();
+		if (l_length > 0 && (i == 0 || load_fragments) && (l_item->getUint8Array(l_data).bad() || l_data == NULL))
+			return false;
+		if (i == 0)
+		{
+			l_table = l_data;
+			l_table_length = l_length;
+		}
+		else
+		{
+			Fragment l_fragment = { l_data, l_length, l_item };
+			m_fragments.push_back(l_fragment);
+		}
+	}
+	if (m_fragments.empty() || frame_num <= 0)
+		return false;
+
+	if (frame_num == 1)
+		m_frames.push_back(std::make_pair(0, (int)m_fragments.size()));
+	else if (m_fragments.size() == (size_t)frame_num)
+	{
+		for (int k = 0; k < frame_num; ++k)
+			m_frames.push_back(std::make_pair(k, 1));
+	}
+	else if (!split_by_offset_table(l_table, l_table_length, frame_num))
+		split_by_codestream_start(frame_num);
+	return (int)m_frames.size() == frame_num;
+}
+
+bool DicomJ2kDecoder::decode_frame(int frame_idx, unsigned char *dst, size_t dst_bytes,
+	int bits_allocated, int samples_per_pixel, int planar_configuration, DcmFileCache *cache) const
+{
+	if (frame_idx < 0 || frame_idx >= (int)m_frames.size() || (bits_allocated != 8 && bits_allocated != 16))
+		return false;
+
+	// 1. one codestream per frame, fragments are joined only when a frame is split
+	// or read from the file
+	const int l_first = m_frames[frame_idx].first;
+	const int l_count = m_frames[frame_idx].second;
+	std::vector<unsigned char> l_joined;
+	J2kMemoryStream l_source = { m_fragments[l_first].data, m_fragments[l_first].length, 0 };
+	if (l_count > 1 || l_source.data == NULL)
+	{
+		for (int i = l_first; i < l_first + l_count; ++i)
+		{
+			const Fragment &l_fragment = m_fragments[i];
+			size_t l_offset = l_joined.size();
+			l_joined.resize(l_offset + l_fragment.length);
+			if (l_fragment.data != NULL)
+				memcpy(l_joined.data() + l_offset, l_fragment.data, l_fragment.length);
+			else if (l_fragment.length > 0 && l_fragment.item->getPartialValue(l_joined.data() + l_offset, 0,
+				(Uint32)l_fragment.length, cache).bad())
+				return false;
+		}
+		l_source.data = l_joined.data();
+		l_source.length = l_joined.size();
+	}
+
+	// 2. decode
+	opj_codec_t *l_codec = opj_create_decompress(is_codestream_start(l_source.data, l_source.length) ? OPJ_CODEC_J2K : OPJ_CODEC_JP2);
+	opj_stream_t *l_stream = opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, OPJ_TRUE);
+	opj_image_t *l_image = NULL;
+	opj_stream_set_user_data(l_stream, &l_source, NULL);
+	opj_stream_set_user_data_length(l_stream, l_source.length);
+	opj_stream_set_read_function(l_stream, j2k_stream_read);
+	opj_stream_set_skip_function(l_stream, j2k_stream_skip);
+	opj_stream_set_seek_function(l_stream, j2k_stream_seek);
+	opj_dparameters_t l_parameters;
+	opj_set_default_decoder_parameters(&l_parameters);
+	bool l_decoded = opj_setup_decoder(l_codec, &l_parameters) != OPJ_FALSE;
+	// a build without thread support refuses this, decoding then stays single threaded
+	if (l_decoded)
+		opj_codec_set_threads(l_codec, omp_in_parallel() ? 1 : omp_get_num_procs());
+	l_decoded = l_decoded
+		&& opj_read_header(l_stream, l_codec, &l_image)
+		&& opj_decode(l_codec, l_stream, l_image)
+		&& opj_end_decompress(l_codec, l_stream);
+
+	// 3. components into the native sample layout
+	const size_t l_sample_bytes = bits_allocated / 8;
+	if (l_decoded && (int)l_image->numcomps >= samples_per_pixel)
+	{
+		const size_t l_pixel_num = (size_t)l_image->comps[0].w * l_image->comps[0].h;
+		l_decoded = l_pixel_num * samples_per_pixel * l_sample_bytes == dst_bytes;
+		for (int c = 0; l_decoded && c < samples_per_pixel; ++c)
+		{
+			const opj_image_comp_t &l_comp = l_image->comps[c];
+			if ((size_t)l_comp.w * l_comp.h != l_pixel_num || l_comp.data == NULL)
+			{
+				l_decoded = false;
+				break;
+			}
+			// color-by-plane keeps each component contiguous, color-by-pixel interleaves them
+			const size_t l_step = planar_configuration == 1 ? 1 : samples_per_pixel;
+			const size_t l_start = planar_configuration == 1 ? c * l_pixel_num : c;
+			if (bits_allocated == 8)
+			{
+				for (size_t i = 0; i < l_pixel_num; ++i)
+					dst[l_start + i * l_step] = (unsigned char)l_comp.data[i];
+			}
+			else
+			{
+				// signed samples keep their two's complement bits, as in uncompressed data
+				Uint16 *l_dst16 = (Uint16 *)dst;
+				for (size_t i = 0; i < l_pixel_num; ++i)
+					l_dst16[l_start + i * l_step] = (Uint16)l_comp.data[i];
+			}
+		}
+	}
+	else
+		l_decoded = false;
+
+	if (l_image != NULL)
+		opj_image_destroy(l_image);
+	opj_stream_destroy(l_stream);
+	opj_destroy_codec(l_codec);
+	return l_decoded;
+}
+
+// protected
+
+// private
+bool DicomJ2kDecoder::split_by_offset_table(const unsigned char *table, size_t table_length, int frame_num)
+{
+	// offsets count from the first fragment item, 8 bytes of item header each
+	if (table == NULL || table_length != (size_t)frame_num * 4)
+		return false;
+	std::vector<size_t> l_item_offsets(m_fragments.size());
+	size_t l_offset = 0;
+	for (int i = 0; i < m_fragments.size(); ++i)
+	{
+		l_item_offsets[i] = l_offset;
+		l_offset += 8 + m_fragments[i].length;
+	}
+	int l_fragment = 0;
+	for (int k = 0; k < frame_num; ++k)
+	{
+		size_t l_frame_offset = table[k * 4] | (table[k * 4 + 1] << 8) | (table[k * 4 + 2] << 16) | ((size_t)table[k * 4 + 3] << 24);
+		while (l_fragment < m_fragments.size() && l_item_offsets[l_fragment] < l_frame_offset)
+			++l_fragment;
+		if (l_fragment == m_fragments.size() || l_item_offsets[l_fragment] != l_frame_offset)
+		{
+			m_frames.clear();
+			return false;
+		}
+		m_frames.push_back(std::make_pair(l_fragment, 0));
+	}
+	for (int k = 0; k < frame_num; ++k)
+	{
+		int l_end = k + 1 < frame_num ? m_frames[k + 1].first : (int)m_fragments.size();
+		m_frames[k].second = l_end - m_frames[k].first;
+	}
+	return true;
+}
+
+void DicomJ2kDecoder::split_by_codestream_start(int frame_num)
+{
+	// without an offset table a new frame starts at every fragment opening with SOC
+	m_frames.clear();
+	for (int i = 0; i < m_fragments.size(); ++i)
+	{
+		if (m_frames.empty() || fragment_starts_codestream(i))
+			m_frames.push_back(std::make_pair(i, 1));
+		else
+			++m_frames.back().second;
+	}
+	if ((int)m_frames.size() != frame_num)
+		m_frames.clear();
+}
+
+bool DicomJ2kDecoder::fragment_starts_codestream(int fragment_idx) const
+{
+	const Fragment &l_fragment = m_fragments[fragment_idx];
+	if (l_fragment.data != NULL)
+		return is_codestream_start(l_fragment.data, l_fragment.length);
+	// only the marker is read of a fragment left on disk
+	unsigned char l_marker[2];
+	return l_fragment.length >= 2 && l_fragment.item->getPartialValue(l_marker, 0, 2).good() &&
+		is_codestream_start(l_marker, 2);
+}
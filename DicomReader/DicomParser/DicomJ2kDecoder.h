@@ -0,0 +1,58 @@
+#pragma once
+// dcmtk
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+// Cpp
+#include <vector>
+class DcmDataset;
+class DcmPixelItem;
+class DcmFileCache;
+
+/*!
+* \brief JPEG 2000 frame decoder on top of OpenJPEG
+* dcmtk ships no free JPEG 2000 codec, so these transfer syntaxes bypass
+* chooseRepresentation: open() locates the fragments of every frame once,
+* then decode_frame() can run on any number of threads at the same time.
+* Frames are written in the native layout dcmtk produces for the other
+* codecs (little endian, BitsAllocated wide samples).
+* Opened without loading the fragments, a frame reads its own fragments from
+* the file when it is decoded, for files too large to hold in memory.
+*/
+class DicomJ2kDecoder
+{
+public:
+	DicomJ2kDecoder();
+	~DicomJ2kDecoder();
+
+	static bool is_j2k(E_TransferSyntax xfer);
+
+	// Build the frame table of the encapsulated PixelData of dataset
+	bool open(DcmDataset *dataset, int frame_num, bool load_fragments = true);
+	int frame_num() const { return (int)m_frames.size(); }
+
+	/*!
+	* \brief Decode one frame into dst
+	* Frames decoded outside a parallel region spread their code blocks over
+	* all cores, inside one every frame stays on its own thread. Fragments that
+	* were not loaded are read through cache, one thread at a time.
+	*/
+	bool decode_frame(int frame_idx, unsigned char *dst, size_t dst_bytes,
+		int bits_allocated, int samples_per_pixel, int planar_configuration, DcmFileCache *cache = NULL) const;
+
+protected:
+
+private:
+	struct Fragment
+	{
+		const unsigned char *data;   // NULL when the value is still on disk
+		size_t length;
+		DcmPixelItem *item;
+	};
+	// first fragment and fragment count of every frame
+	std::vector<Fragment> m_fragments;
+	std::vector<std::pair<int, int> > m_frames;
+
+	bool split_by_offset_table(const unsigned char *table, size_t table_length, int frame_num);
+	void split_by_codestream_start(int frame_num);
+	bool fragment_starts_codestream(int fragment_idx) const;
+};
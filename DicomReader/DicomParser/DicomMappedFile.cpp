@@ -0,0 +1,283 @@
+#ifdef _WIN32
+// windows
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+// Cpp
+#include <cstring>
+// meta
+#include "DicomMappedFile.h"
+
+#define DCM_UNDEFINED_LENGTH 0xFFFFFFFF
+#define DCM_TAG_ITEM 0xFFFEE000
+#define DCM_TAG_ITEM_DELIMITATION 0xFFFEE00D
+#define DCM_TAG_SEQUENCE_DELIMITATION 0xFFFEE0DD
+#define DCM_TAG_TRANSFER_SYNTAX_UID 0x00020010
+#define DCM_TAG_PIXEL_DATA 0x7FE00010
+
+static inline unsigned short read_uint16_le(const unsigned char *p)
+{
+	return (unsigned short)(p[0] | (p[1] << 8));
+}
+
+static inline unsigned int read_uint32_le(const unsigned char *p)
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// VRs written with 2 reserved bytes and a 32 bit length in explicit VR
+static inline bool is_long_vr(const unsigned char *vr)
+{
+	static const char *ms_long_vrs[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+	for (int i = 0; i < sizeof(ms_long_vrs) / sizeof(ms_long_vrs[0]); ++i)
+	{
+		if (vr[0] == ms_long_vrs[i][0] && vr[1] == ms_long_vrs[i][1])
+			return true;
+	}
+	return false;
+}
+
+// public
+DicomMappedFile::DicomMappedFile() :
+	m_data(nullptr),
+	m_size(0),
+#ifdef _WIN32
+	m_file(INVALID_HANDLE_VALUE),
+	m_mapping(nullptr)
+#else
+	m_file(-1)
+#endif
+{
+
+}
+
+DicomMappedFile::~DicomMappedFile()
+{
+	close();
+}
+
+bool DicomMappedFile::open(const std::string &file_path)
+{
+	close();
+#ifdef _WIN32
+	m_file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER l_size;
+	if (!GetFileSizeEx(m_file, &l_size) || l_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		close();
+		return false;
+	}
+	m_data = (const unsigned char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	m_size = (size_t)l_size.QuadPart;
+#else
+	m_file = ::open(file_path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+	struct stat l_stat;
+	if (fstat(m_file, &l_stat) != 0 || l_stat.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	void *l_data = mmap(NULL, l_stat.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (l_data != MAP_FAILED)
+	{
+		madvise(l_data, l_stat.st_size, MADV_SEQUENTIAL);
+		m_data = (const unsigned char *)l_data;
+	}
+	m_size = (size_t)l_stat.st_size;
+#endif
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void DicomMappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data != nullptr)
+		munmap((void *)m_data, m_size);
+	if (m_file >= 0)
+		::close(m_file);
+	m_file = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+bool DicomMappedFile::locate_pixel_data(size_t &offset, size_t &length)
+{
+	// 1. preamble and meta header, always Explicit VR Little Endian
+	if (m_size < 132 || memcmp(m_data + 128, "DICM", 4) != 0)
+		return false;
+	size_t l_pos = 132;
+	std::string l_transfer_syntax;
+	while (l_pos + 8 <= m_size && read_uint16_le(m_data + l_pos) == 0x0002)
+	{
+		unsigned int l_tag, l_length;
+		bool l_implicit_content;
+		if (!read_element_header(l_pos, true, l_tag, l_length, l_implicit_content) ||
+			l_length == DCM_UNDEFINED_LENGTH || l_length > m_size - l_pos)
+			return false;
+		if (l_tag == DCM_TAG_TRANSFER_SYNTAX_UID)
+		{
+			l_transfer_syntax.assign((const char *)m_data + l_pos, l_length);
+			while (!l_transfer_syntax.empty() &&
+				(l_transfer_syntax.back() == '\0' || l_transfer_syntax.back() == ' '))
+				l_transfer_syntax.pop_back();
+		}
+		l_pos += l_length;
+	}
+
+	bool l_explicit_vr;
+	if (l_transfer_syntax == "1.2.840.10008.1.2.1")
+		l_explicit_vr = true;
+	else if (l_transfer_syntax == "1.2.840.10008.1.2")
+		l_explicit_vr = false;
+	else
+		return false;
+
+	// 2. top level dataset elements up to PixelData
+	while (l_pos + 8 <= m_size)
+	{
+		unsigned int l_tag, l_length;
+		bool l_implicit_content;
+		if (!read_element_header(l_pos, l_explicit_vr, l_tag, l_length, l_implicit_content))
+			return false;
+		if (l_tag == DCM_TAG_PIXEL_DATA)
+		{
+			// undefined length means encapsulated pixel data
+			if (l_length == DCM_UNDEFINED_LENGTH || l_length > m_size - l_pos)
+				return false;
+			offset = l_pos;
+			length = l_length;
+			return true;
+		}
+		if (l_tag > DCM_TAG_PIXEL_DATA)
+			return false;
+		if (l_length == DCM_UNDEFINED_LENGTH)
+		{
+			if (!skip_sequence(l_pos, l_explicit_vr && !l_implicit_content))
+				return false;
+		}
+		else
+		{
+			if (l_length > m_size - l_pos)
+				return false;
+			l_pos += l_length;
+		}
+	}
+	return false;
+}
+
+// protected
+
+// private
+bool DicomMappedFile::read_element_header(size_t &pos, bool explicit_vr, unsigned int &tag, unsigned int &length, bool &implicit_content)
+{
+	if (pos + 8 > m_size)
+		return false;
+	const unsigned char *l_ptr = m_data + pos;
+	tag = ((unsigned int)read_uint16_le(l_ptr) << 16) | read_uint16_le(l_ptr + 2);
+	implicit_content = false;
+
+	// items and delimiters carry no VR
+	if (!explicit_vr || (tag >> 16) == 0xFFFE)
+	{
+		length = read_uint32_le(l_ptr + 4);
+		pos += 8;
+		return true;
+	}
+	if (is_long_vr(l_ptr + 4))
+	{
+		if (pos + 12 > m_size)
+			return false;
+		// UN of undefined length is encoded as Implicit VR Little Endian
+		implicit_content = l_ptr[4] == 'U' && l_ptr[5] == 'N';
+		length = read_uint32_le(l_ptr + 8);
+		pos += 12;
+	}
+	else
+	{
+		length = read_uint16_le(l_ptr + 6);
+		pos += 8;
+	}
+	return true;
+}
+
+bool DicomMappedFile::skip_sequence(size_t &pos, bool explicit_vr)
+{
+	while (pos + 8 <= m_size)
+	{
+		unsigned int l_tag, l_length;
+		bool l_implicit_content;
+		if (!read_element_header(pos, explicit_vr, l_tag, l_length, l_implicit_content))
+			return false;
+		if (l_tag == DCM_TAG_SEQUENCE_DELIMITATION)
+			return true;
+		if (l_tag != DCM_TAG_ITEM)
+			return false;
+		if (l_length == DCM_UNDEFINED_LENGTH)
+		{
+			if (!skip_item(pos, explicit_vr))
+				return false;
+		}
+		else
+		{
+			if (l_length > m_size - pos)
+				return false;
+			pos += l_length;
+		}
+	}
+	return false;
+}
+
+bool DicomMappedFile::skip_item(size_t &pos, bool explicit_vr)
+{
+	while (pos + 8 <= m_size)
+	{
+		unsigned int l_tag, l_length;
+		bool l_implicit_content;
+		if (!read_element_header(pos, explicit_vr, l_tag, l_length, l_implicit_content))
+			return false;
+		if (l_tag == DCM_TAG_ITEM_DELIMITATION)
+			return true;
+		if (l_length == DCM_UNDEFINED_LENGTH)
+		{
+			if (!skip_sequence(pos, explicit_vr && !l_implicit_content))
+				return false;
+		}
+		else
+		{
+			if (l_length > m_size - pos)
+				return false;
+			pos += l_length;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+// Cpp
+#include <string>
+
+/*!
+* \brief Read-only memory mapping of a dicom file
+* Used by the uncompressed pixel fast path, the pixel values are converted
+* straight from the mapped pages without going through a DcmDataset.
+*/
+class DicomMappedFile
+{
+public:
+	DicomMappedFile();
+	~DicomMappedFile();
+
+	bool open(const std::string &file_path);
+	void close();
+
+	const unsigned char *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	/*!
+	* \brief Walk the mapped stream up to the (7FE0,0010) PixelData element
+	* Only native Explicit/Implicit VR Little Endian files are handled, false
+	* for anything else so the caller can fall back to dcmtk.
+	*/
+	bool locate_pixel_data(size_t &offset, size_t &length);
+
+protected:
+
+private:
+	const unsigned char *m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void *m_file;
+	void *m_mapping;
+#else
+	int m_file;
+#endif
+
+	bool read_element_header(size_t &pos, bool explicit_vr, unsigned int &tag, unsigned int &length, bool &implicit_content);
+	bool skip_sequence(size_t &pos, bool explicit_vr);
+	bool skip_item(size_t &pos, bool explicit_vr);
+};
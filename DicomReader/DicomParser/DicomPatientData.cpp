@@ -6,6 +6,7 @@
 
 // public
 DicomPatientData::DicomPatientData() :
+	m_details_loaded(false),
 	/*m_study_lock(QReadWriteLock::Recursive),*/
 	m_patient_plate_image(nullptr)/*,
 	m_patient_plate_lock(QReadWriteLock::Recursive)*/
@@ -15,7 +16,7 @@ DicomPatientData::DicomPatientData() :
 
 void DicomPatientData::clear_data()
 {
-	/*m_study_lock.lockForWrite();*/
+	m_study_lock.lock();
 	int l_study_num = m_studies.size();
 	for (int i = 0; i < l_study_num; ++i)
 	{
@@ -25,7 +26,7 @@ void DicomPatientData::clear_data()
 	}
 	m_studies.clear();
 	m_study_ID_to_idx_map.clear();
-	/*m_study_lock.unlock();*/
+	m_study_lock.unlock();
 
 	/*m_patient_plate_lock.lockForWrite();*/
 	if (m_patient_plate_image != nullptr)
@@ -39,18 +40,21 @@ void DicomPatientData::clear_data()
 bool DicomPatientData::check_study_available(std::string &study_ID, int &idx)
 {
 	bool l_ret = false;
-	/*m_study_lock.lockForRead();*/
+	m_study_lock.lock_shared();
 	auto l_iter = m_study_ID_to_idx_map.find(study_ID);
 	l_ret = l_iter != m_study_ID_to_idx_map.end();
 	if (l_ret)
 		idx = l_iter->second;
-	/*m_study_lock.unlock();*/
+	m_study_lock.unlock_shared();
 	return l_ret;
 }
 
 bool DicomPatientData::check_series_available(int study_idx, std::string &series_number, int &idx)
 {
-	return m_studies[study_idx]->check_series_available(series_number, idx);
+	m_study_lock.lock_shared();
+	DicomStudyData *l_study_data = m_studies[study_idx];
+	m_study_lock.unlock_shared();
+	return l_study_data->check_series_available(series_number, idx);
 }
 
 // protected
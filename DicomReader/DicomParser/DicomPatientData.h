@@ -6,6 +6,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <shared_mutex>
 // local
 class DicomStudyData;
 class DicomPatientPlateImage;
@@ -20,10 +21,11 @@ public:
 	std::string m_patient_age;
 	std::string m_patient_position;
 	std::string m_patient_orientation;
+	bool m_details_loaded;   //false after a geometry only scan, DicomHeaderParser::load_details fills the fields above
 
 	std::vector<DicomStudyData *> m_studies;
 	std::map<std::string, int> m_study_ID_to_idx_map;
-	/*QReadWriteLock m_study_lock;*/
+	std::shared_timed_mutex m_study_lock;
 
 	DicomPatientPlateImage *m_patient_plate_image;
 	/*QReadWriteLock m_patient_plate_lock;*/
@@ -0,0 +1,406 @@
+// meta
+#include "DicomPixelKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DICOM_PIXEL_KERNELS_X86
+#endif
+
+#ifdef DICOM_PIXEL_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// msvc emits any intrinsic without /arch, gcc and clang need the target per function
+#if defined(DICOM_PIXEL_KERNELS_X86) && !defined(_MSC_VER)
+#define DICOM_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define DICOM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DICOM_TARGET_SSE41
+#define DICOM_TARGET_AVX2
+#endif
+
+// scalar
+static int mono8_scalar(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	for (int i = 0; i < pixel_num; ++i)
+	{
+		short l_value = l_src[i];
+		dst[i] = (short)(l_value * rescale_slope + rescale_intercept);
+	}
+	return 0;
+}
+
+static int mono16_scalar(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned short *l_src = (const unsigned short *)src;
+	int l_label_count = 0;
+	for (int i = 0; i < pixel_num; ++i)
+	{
+		short l_value = l_src[i];
+		l_value = (short)(l_value * rescale_slope + rescale_intercept);
+		dst[i] = l_value;
+		if (l_value == -1024 || l_value == -1025)
+			++l_label_count;
+	}
+	return l_label_count;
+}
+
+static int rgb8_interleaved_scalar(const void *src, short *dst, int pixel_num, float, float)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	for (int i = 0; i < pixel_num * 3; ++i)
+		dst[i] = (short)l_src[i];
+	return 0;
+}
+
+static int rgb8_planar_scalar(const void *src, short *dst, int pixel_num, float, float)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	for (int i = 0; i < pixel_num; ++i)
+	{
+		dst[3 * i] = (short)l_src[i];
+		dst[3 * i + 1] = (short)l_src[pixel_num + i];
+		dst[3 * i + 2] = (short)l_src[pixel_num * 2 + i];
+	}
+	return 0;
+}
+
+#ifdef DICOM_PIXEL_KERNELS_X86
+// The float to short cast truncates to int32 and keeps the low 16 bits,
+// masking before the unsigned pack reproduces that without saturation.
+// Multiply and add stay separate so no fma changes the rounding.
+
+// sse4.1
+DICOM_TARGET_SSE41 static inline __m128i rescale_8x_sse41(__m128i lo, __m128i hi, __m128 slope, __m128 intercept)
+{
+	const __m128i l_mask = _mm_set1_epi32(0xFFFF);
+	__m128i l_lo = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), slope), intercept));
+	__m128i l_hi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), slope), intercept));
+	return _mm_packus_epi32(_mm_and_si128(l_lo, l_mask), _mm_and_si128(l_hi, l_mask));
+}
+
+DICOM_TARGET_SSE41 static int mono8_sse41(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	const __m128 l_slope = _mm_set1_ps(rescale_slope);
+	const __m128 l_intercept = _mm_set1_ps(rescale_intercept);
+	int i = 0;
+	for (; i + 8 <= pixel_num; i += 8)
+	{
+		__m128i l_value = _mm_loadl_epi64((const __m128i *)(l_src + i));
+		__m128i l_lo = _mm_cvtepu8_epi32(l_value);
+		__m128i l_hi = _mm_cvtepu8_epi32(_mm_srli_si128(l_value, 4));
+		_mm_storeu_si128((__m128i *)(dst + i), rescale_8x_sse41(l_lo, l_hi, l_slope, l_intercept));
+	}
+	mono8_scalar(l_src + i, dst + i, pixel_num - i, rescale_slope, rescale_intercept);
+	return 0;
+}
+
+DICOM_TARGET_SSE41 static int mono16_sse41(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned short *l_src = (const unsigned short *)src;
+	const __m128 l_slope = _mm_set1_ps(rescale_slope);
+	const __m128 l_intercept = _mm_set1_ps(rescale_intercept);
+	const __m128i l_label0 = _mm_set1_epi16(-1024);
+	const __m128i l_label1 = _mm_set1_epi16(-1025);
+	const __m128i l_minus_one = _mm_set1_epi16(-1);
+	__m128i l_label_count = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= pixel_num; i += 8)
+	{
+		__m128i l_value = _mm_loadu_si128((const __m128i *)(l_src + i));
+		__m128i l_lo = _mm_cvtepi16_epi32(l_value);
+		__m128i l_hi = _mm_cvtepi16_epi32(_mm_srli_si128(l_value, 8));
+		__m128i l_result = rescale_8x_sse41(l_lo, l_hi, l_slope, l_intercept);
+		_mm_storeu_si128((__m128i *)(dst + i), l_result);
+		__m128i l_is_label = _mm_or_si128(_mm_cmpeq_epi16(l_result, l_label0), _mm_cmpeq_epi16(l_result, l_label1));
+		l_label_count = _mm_add_epi32(l_label_count, _mm_madd_epi16(l_is_label, l_minus_one));
+	}
+	l_label_count = _mm_add_epi32(l_label_count, _mm_srli_si128(l_label_count, 8));
+	l_label_count = _mm_add_epi32(l_label_count, _mm_srli_si128(l_label_count, 4));
+	return _mm_cvtsi128_si32(l_label_count) +
+		mono16_scalar(l_src + i, dst + i, pixel_num - i, rescale_slope, rescale_intercept);
+}
+
+DICOM_TARGET_SSE41 static int rgb8_interleaved_sse41(const void *src, short *dst, int pixel_num, float, float)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	const int l_value_num = pixel_num * 3;
+	int i = 0;
+	for (; i + 16 <= l_value_num; i += 16)
+	{
+		__m128i l_value = _mm_loadu_si128((const __m128i *)(l_src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtepu8_epi16(l_value));
+		_mm_storeu_si128((__m128i *)(dst + i + 8), _mm_cvtepu8_epi16(_mm_srli_si128(l_value, 8)));
+	}
+	for (; i < l_value_num; ++i)
+		dst[i] = (short)l_src[i];
+	return 0;
+}
+
+DICOM_TARGET_SSE41 static int rgb8_planar_sse41(const void *src, short *dst, int pixel_num, float, float)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	// 8 pixels of r|g and b shuffled into 24 interleaved bytes
+	const __m128i l_rg_shuffle0 = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+	const __m128i l_b_shuffle0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i l_rg_shuffle1 = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i l_b_shuffle1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+	int i = 0;
+	for (; i + 8 <= pixel_num; i += 8)
+	{
+		__m128i l_r = _mm_loadl_epi64((const __m128i *)(l_src + i));
+		__m128i l_g = _mm_loadl_epi64((const __m128i *)(l_src + pixel_num + i));
+		__m128i l_b = _mm_loadl_epi64((const __m128i *)(l_src + pixel_num * 2 + i));
+		__m128i l_rg = _mm_unpacklo_epi64(l_r, l_g);
+		__m128i l_rgb0 = _mm_or_si128(_mm_shuffle_epi8(l_rg, l_rg_shuffle0), _mm_shuffle_epi8(l_b, l_b_shuffle0));
+		__m128i l_rgb1 = _mm_or_si128(_mm_shuffle_epi8(l_rg, l_rg_shuffle1), _mm_shuffle_epi8(l_b, l_b_shuffle1));
+		_mm_storeu_si128((__m128i *)(dst + 3 * i), _mm_cvtepu8_epi16(l_rgb0));
+		_mm_storeu_si128((__m128i *)(dst + 3 * i + 8), _mm_cvtepu8_epi16(_mm_srli_si128(l_rgb0, 8)));
+		_mm_storeu_si128((__m128i *)(dst + 3 * i + 16), _mm_cvtepu8_epi16(l_rgb1));
+	}
+	for (; i < pixel_num; ++i)
+	{
+		dst[3 * i] = (short)l_src[i];
+		dst[3 * i + 1] = (short)l_src[pixel_num + i];
+		dst[3 * i + 2] = (short)l_src[pixel_num * 2 + i];
+	}
+	return 0;
+}
+
+// avx2
+DICOM_TARGET_AVX2 static inline __m256i rescale_16x_avx2(__m256i lo, __m256i hi, __m256 slope, __m256 intercept)
+{
+	const __m256i l_mask = _mm256_set1_epi32(0xFFFF);
+	__m256i l_lo = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), slope), intercept));
+	__m256i l_hi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), slope), intercept));
+	// the pack works per 128 bit lane, put the quarters back in order
+	__m256i l_packed = _mm256_packus_epi32(_mm256_and_si256(l_lo, l_mask), _mm256_and_si256(l_hi, l_mask));
+	return _mm256_permute4x64_epi64(l_packed, 0xD8);
+}
+
+DICOM_TARGET_AVX2 static int mono8_avx2(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	const __m256 l_slope = _mm256_set1_ps(rescale_slope);
+	const __m256 l_intercept = _mm256_set1_ps(rescale_intercept);
+	int i = 0;
+	for (; i + 16 <= pixel_num; i += 16)
+	{
+		__m128i l_value = _mm_loadu_si128((const __m128i *)(l_src + i));
+		__m256i l_lo = _mm256_cvtepu8_epi32(l_value);
+		__m256i l_hi = _mm256_cvtepu8_epi32(_mm_srli_si128(l_value, 8));
+		_mm256_storeu_si256((__m256i *)(dst + i), rescale_16x_avx2(l_lo, l_hi, l_slope, l_intercept));
+	}
+	mono8_scalar(l_src + i, dst + i, pixel_num - i, rescale_slope, rescale_intercept);
+	return 0;
+}
+
+DICOM_TARGET_AVX2 static int mono16_avx2(const void *src, short *dst, int pixel_num, float rescale_slope, float rescale_intercept)
+{
+	const unsigned short *l_src = (const unsigned short *)src;
+	const __m256 l_slope = _mm256_set1_ps(rescale_slope);
+	const __m256 l_intercept = _mm256_set1_ps(rescale_intercept);
+	const __m256i l_label0 = _mm256_set1_epi16(-1024);
+	const __m256i l_label1 = _mm256_set1_epi16(-1025);
+	const __m256i l_minus_one = _mm256_set1_epi16(-1);
+	__m256i l_label_count = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 16 <= pixel_num; i += 16)
+	{
+		__m256i l_value = _mm256_loadu_si256((const __m256i *)(l_src + i));
+		__m256i l_lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(l_value));
+		__m256i l_hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(l_value, 1));
+		__m256i l_result = rescale_16x_avx2(l_lo, l_hi, l_slope, l_intercept);
+		_mm256_storeu_si256((__m256i *)(dst + i), l_result);
+		__m256i l_is_label = _mm256_or_si256(_mm256_cmpeq_epi16(l_result, l_label0), _mm256_cmpeq_epi16(l_result, l_label1));
+		l_label_count = _mm256_add_epi32(l_label_count, _mm256_madd_epi16(l_is_label, l_minus_one));
+	}
+	__m128i l_count = _mm_add_epi32(_mm256_castsi256_si128(l_label_count), _mm256_extracti128_si256(l_label_count, 1));
+	l_count = _mm_add_epi32(l_count, _mm_srli_si128(l_count, 8));
+	l_count = _mm_add_epi32(l_count, _mm_srli_si128(l_count, 4));
+	return _mm_cvtsi128_si32(l_count) +
+		mono16_scalar(l_src + i, dst + i, pixel_num - i, rescale_slope, rescale_intercept);
+}
+
+DICOM_TARGET_AVX2 static int rgb8_interleaved_avx2(const void *src, short *dst, int pixel_num, float, float)
+{
+	const unsigned char *l_src = (const unsigned char *)src;
+	const int l_value_num = pixel_num * 3;
+	int i = 0;
+	for (; i + 16 <= l_value_num; i += 16)
+	{
+		__m128i l_value = _mm_loadu_si128((const __m128i *)(l_src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtepu8_epi16(l_value));
+	}
+	for (; i < l_value_num; ++i)
+		dst[i] = (short)l_src[i];
+	return 0;
+}
+#endif
+
+// public
+DicomPixelKernels::SimdLevel DicomPixelKernels::simd_level()
+{
+	static const SimdLevel ms_level = detect_simd_level();
+	return ms_level;
+}
+
+bool DicomPixelKernels::select(int bit_num, const std::string &sample_num, int planar_configuration,
+	const std::string &modality, float rescale_slope, float rescale_intercept,
+	DicomPixelKernel &kernel, SimdLevel max_level)
+{
+	SimdLevel l_level = simd_level() < max_level ? simd_level() : max_level;
+	kernel.func = nullptr;
+	kernel.bit_num = bit_num;
+	kernel.rescale_slope = rescale_slope;
+	kernel.rescale_intercept = rescale_intercept;
+	kernel.label_check = false;
+
+	if (bit_num == 8 && sample_num == "1")
+	{
+		kernel.sample_count = 1;
+		kernel.func = mono8_scalar;
+		kernel.name = "mono8_scalar";
+#ifdef DICOM_PIXEL_KERNELS_X86
+		if (l_level >= SIMD_AVX2)
+		{
+			kernel.func = mono8_avx2;
+			kernel.name = "mono8_avx2";
+		}
+		else if (l_level >= SIMD_SSE41)
+		{
+			kernel.func = mono8_sse41;
+			kernel.name = "mono8_sse41";
+		}
+#endif
+	}
+	else if (bit_num == 8 && sample_num == "3" && planar_configuration == 1)
+	{
+		kernel.sample_count = 3;
+		kernel.func = rgb8_planar_scalar;
+		kernel.name = "rgb8_planar_scalar";
+#ifdef DICOM_PIXEL_KERNELS_X86
+		// the byte shuffle has no wider form worth having, avx2 cpus run it too
+		if (l_level >= SIMD_SSE41)
+		{
+			kernel.func = rgb8_planar_sse41;
+			kernel.name = "rgb8_planar_sse41";
+		}
+#endif
+	}
+	else if (bit_num == 8 && sample_num == "3")
+	{
+		kernel.sample_count = 3;
+		kernel.func = rgb8_interleaved_scalar;
+		kernel.name = "rgb8_interleaved_scalar";
+#ifdef DICOM_PIXEL_KERNELS_X86
+		if (l_level >= SIMD_AVX2)
+		{
+			kernel.func = rgb8_interleaved_avx2;
+			kernel.name = "rgb8_interleaved_avx2";
+		}
+		else if (l_level >= SIMD_SSE41)
+		{
+			kernel.func = rgb8_interleaved_sse41;
+			kernel.name = "rgb8_interleaved_sse41";
+		}
+#endif
+	}
+	else if (bit_num == 16 && sample_num == "1")
+	{
+		kernel.sample_count = 1;
+		if (modality == "DR")
+		{
+			// DR slices without a usable slope only get the intercept added
+			if (rescale_slope < 0.0001)
+				kernel.rescale_slope = 1.0f;
+		}
+		else
+		{
+			kernel.label_check = true;
+		}
+		kernel.func = mono16_scalar;
+		kernel.name = "mono16_scalar";
+#ifdef DICOM_PIXEL_KERNELS_X86
+		if (l_level >= SIMD_AVX2)
+		{
+			kernel.func = mono16_avx2;
+			kernel.name = "mono16_avx2";
+		}
+		else if (l_level >= SIMD_SSE41)
+		{
+			kernel.func = mono16_sse41;
+			kernel.name = "mono16_sse41";
+		}
+#endif
+	}
+	else
+	{
+		kernel.sample_count = 0;
+		kernel.name = "";
+		return false;
+	}
+	return true;
+}
+
+// protected
+
+// private
+DicomPixelKernels::SimdLevel DicomPixelKernels::detect_simd_level()
+{
+#ifdef DICOM_PIXEL_KERNELS_X86
+	unsigned int l_regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+	__cpuid((int *)l_regs, 0);
+#else
+	__cpuid(0, l_regs[0], l_regs[1], l_regs[2], l_regs[3]);
+#endif
+	unsigned int l_max_leaf = l_regs[0];
+	if (l_max_leaf < 1)
+		return SIMD_SCALAR;
+
+#ifdef _MSC_VER
+	__cpuid((int *)l_regs, 1);
+#else
+	__cpuid(1, l_regs[0], l_regs[1], l_regs[2], l_regs[3]);
+#endif
+	bool l_sse41 = (l_regs[2] & (1u << 19)) != 0;
+	bool l_osxsave = (l_regs[2] & (1u << 27)) != 0;
+	bool l_avx = (l_regs[2] & (1u << 28)) != 0;
+	if (!l_sse41)
+		return SIMD_SCALAR;
+
+	// the os has to save the ymm registers as well
+	bool l_ymm_enabled = false;
+	if (l_osxsave && l_avx)
+	{
+#ifdef _MSC_VER
+		unsigned long long l_xcr0 = _xgetbv(0);
+#else
+		unsigned int l_xcr0_lo, l_xcr0_hi;
+		__asm__ volatile("xgetbv" : "=a"(l_xcr0_lo), "=d"(l_xcr0_hi) : "c"(0));
+		unsigned long long l_xcr0 = ((unsigned long long)l_xcr0_hi << 32) | l_xcr0_lo;
+#endif
+		l_ymm_enabled = (l_xcr0 & 0x6) == 0x6;
+	}
+	if (l_ymm_enabled && l_max_leaf >= 7)
+	{
+#ifdef _MSC_VER
+		__cpuidex((int *)l_regs, 7, 0);
+#else
+		__cpuid_count(7, 0, l_regs[0], l_regs[1], l_regs[2], l_regs[3]);
+#endif
+		if (l_regs[1] & (1u << 5))
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE41;
+#else
+	return SIMD_SCALAR;
+#endif
+}
@@ -0,0 +1,50 @@
+#pragma once
+// Cpp
+#include <string>
+
+/*!
+* \brief Converts one slice of raw pixels into the short output buffer
+* Returns the number of -1024/-1025 results for 16 bit mono kernels, 0 otherwise.
+*/
+typedef int(*DicomPixelKernelFunc)(const void *src, short *dst, int pixel_num,
+	float rescale_slope, float rescale_intercept);
+
+struct DicomPixelKernel
+{
+	DicomPixelKernelFunc func;
+	int bit_num;
+	int sample_count;
+	float rescale_slope;
+	float rescale_intercept;
+	// non DR 16 bit slices made only of -1024/-1025 are label volumes
+	bool label_check;
+	const char *name;
+};
+
+/*!
+* \brief SIMD rescale/convert kernels used by DicomDataParser
+* One kernel per (bit depth, sample count, planar configuration), picked once
+* per series for the best instruction set of the running cpu. Every level
+* produces the same output as the scalar loop.
+*/
+class DicomPixelKernels
+{
+public:
+	enum SimdLevel
+	{
+		SIMD_SCALAR = 0,
+		SIMD_SSE41,
+		SIMD_AVX2
+	};
+
+	static SimdLevel simd_level();
+
+	static bool select(int bit_num, const std::string &sample_num, int planar_configuration,
+		const std::string &modality, float rescale_slope, float rescale_intercept,
+		DicomPixelKernel &kernel, SimdLevel max_level = SIMD_AVX2);
+
+protected:
+
+private:
+	static SimdLevel detect_simd_level();
+};
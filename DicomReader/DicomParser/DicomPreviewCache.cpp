@@ -0,0 +1,92 @@
+// Cpp
+#include <cstdio>
+// meta
+#include "DicomPreviewCache.h"
+
+// public
+DicomPreviewCache *DicomPreviewCache::get_instance()
+{
+	static DicomPreviewCache ls_instance;
+	return &ls_instance;
+}
+
+std::string DicomPreviewCache::make_key(const std::string &series_key, int max_size, int slice_count)
+{
+	char l_suffix[24];
+	snprintf(l_suffix, sizeof(l_suffix), "|%d|%d", max_size, slice_count);
+	return series_key + l_suffix;
+}
+
+void DicomPreviewCache::set_max_bytes(size_t max_bytes)
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_max_bytes = max_bytes;
+	evict_to(m_max_bytes);
+}
+
+bool DicomPreviewCache::get(const std::string &key, DicomPreview &preview)
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	auto l_iter = m_key_to_entry.find(key);
+	if (l_iter == m_key_to_entry.end())
+		return false;
+	m_entries.splice(m_entries.begin(), m_entries, l_iter->second);
+	preview = l_iter->second->preview;
+	return true;
+}
+
+bool DicomPreviewCache::contains(const std::string &key)
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	return m_key_to_entry.find(key) != m_key_to_entry.end();
+}
+
+void DicomPreviewCache::put(const std::string &key, DicomPreview &&preview)
+{
+	size_t l_bytes = preview.pixels.size();
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	if (l_bytes > m_max_bytes)
+		return;
+	auto l_iter = m_key_to_entry.find(key);
+	if (l_iter != m_key_to_entry.end())
+	{
+		m_used_bytes -= l_iter->second->preview.pixels.size();
+		m_entries.erase(l_iter->second);
+		m_key_to_entry.erase(l_iter);
+	}
+	evict_to(m_max_bytes - l_bytes);
+	Entry l_entry;
+	l_entry.key = key;
+	l_entry.preview = std::move(preview);
+	m_entries.push_front(std::move(l_entry));
+	m_key_to_entry[key] = m_entries.begin();
+	m_used_bytes += l_bytes;
+}
+
+void DicomPreviewCache::clear()
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_entries.clear();
+	m_key_to_entry.clear();
+	m_used_bytes = 0;
+}
+
+// protected
+
+// private
+DicomPreviewCache::DicomPreviewCache() :
+	m_max_bytes(64 * 1024 * 1024),
+	m_used_bytes(0)
+{
+}
+
+void DicomPreviewCache::evict_to(size_t max_bytes)
+{
+	while (m_used_bytes > max_bytes && !m_entries.empty())
+	{
+		Entry &l_entry = m_entries.back();
+		m_used_bytes -= l_entry.preview.pixels.size();
+		m_key_to_entry.erase(l_entry.key);
+		m_entries.pop_back();
+	}
+}
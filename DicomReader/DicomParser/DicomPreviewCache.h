@@ -0,0 +1,58 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+// A few reduced slices of one series, windowed to 8 bit
+struct DicomPreview
+{
+	unsigned short width;
+	unsigned short height;
+	int sample_num;     // 1 grey, 3 RGB interleaved
+	int slice_num;
+	// slice_num images of width * height * sample_num bytes in instance order
+	std::vector<unsigned char> pixels;
+};
+
+/*!
+* \brief Process wide LRU cache of series previews
+* Entries are keyed by series, preview size and slice count, so browsing back
+* to a series or reopening a study shows its preview without touching a file.
+* Previews are a few KB each, the default budget holds thousands of them.
+*/
+class DicomPreviewCache
+{
+public:
+	static DicomPreviewCache *get_instance();
+
+	static std::string make_key(const std::string &series_key, int max_size, int slice_count);
+
+	void set_max_bytes(size_t max_bytes);
+
+	bool get(const std::string &key, DicomPreview &preview);
+	bool contains(const std::string &key);
+	void put(const std::string &key, DicomPreview &&preview);
+	void clear();
+
+protected:
+
+private:
+	struct Entry
+	{
+		std::string key;
+		DicomPreview preview;
+	};
+
+	std::list<Entry> m_entries;   // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> m_key_to_entry;
+	std::mutex m_mutex;
+	size_t m_max_bytes;
+	size_t m_used_bytes;
+
+	DicomPreviewCache();
+
+	void evict_to(size_t max_bytes);
+};
@@ -0,0 +1,280 @@
+// dcmtk
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmimgle/dcmimage.h>
+#include <dcmtk/dcmimage/diregist.h>
+// local
+#include "DicomCodecRegistry.h"
+#include "DicomJ2kDecoder.h"
+#include "DicomPreviewCache.h"
+// meta
+#include "DicomPreviewLoader.h"
+// Cpp
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// public
+DicomPreviewLoader::DicomPreviewLoader(int thread_num) :
+	m_stopped(false)
+{
+	if (thread_num <= 0)
+		thread_num = std::min(4, (int)std::thread::hardware_concurrency());
+	thread_num = std::max(thread_num, 1);
+	for (int i = 0; i < thread_num; ++i)
+		m_workers.push_back(std::thread(&DicomPreviewLoader::render_loop, this));
+}
+
+DicomPreviewLoader::~DicomPreviewLoader()
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_mutex);
+		m_stopped = true;
+	}
+	m_job_cv.notify_all();
+	for (int i = 0; i < m_workers.size(); ++i)
+		m_workers[i].join();
+}
+
+void DicomPreviewLoader::request(const std::string &key, const std::vector<DicomPreviewSource> &sources, int max_size)
+{
+	if (sources.empty())
+		return;
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	// checked under the lock, a worker caches a preview before it leaves m_pending
+	if (m_pending.find(key) != m_pending.end() || DicomPreviewCache::get_instance()->contains(key))
+		return;
+	std::shared_ptr<PendingPreview> l_pending = std::make_shared<PendingPreview>();
+	l_pending->max_size = max_size;
+	l_pending->remaining = (int)sources.size();
+	l_pending->slices.resize(sources.size());
+	m_pending[key] = l_pending;
+
+	// the newest request is the series on screen, its slices keep their order
+	for (int i = (int)sources.size() - 1; i >= 0; --i)
+	{
+		RenderJob l_job;
+		l_job.key = key;
+		l_job.slot = i;
+		l_job.source = sources[i];
+		m_jobs.push_front(l_job);
+	}
+	m_job_cv.notify_all();
+}
+
+bool DicomPreviewLoader::wait(const std::string &key, int timeout_ms)
+{
+	std::unique_lock<std::mutex> l_lock(m_mutex);
+	auto l_done = [this, &key]() { return m_pending.find(key) == m_pending.end(); };
+	if (timeout_ms < 0)
+	{
+		m_done_cv.wait(l_lock, l_done);
+		return true;
+	}
+	return m_done_cv.wait_for(l_lock, std::chrono::milliseconds(timeout_ms), l_done);
+}
+
+bool DicomPreviewLoader::render_slice(const DicomPreviewSource &source, int max_size, DicomPreview &slice)
+{
+	DicomCodecRegistry::register_codecs();
+
+	// partial access reads and decompresses only the requested frame
+	DicomImage l_image(source.file_path.c_str(), CIF_UsePartialAccessToPixelData, source.frame_idx, 1);
+	if (l_image.getStatus() != EIS_Normal)
+		return render_j2k(source, max_size, slice);
+
+	unsigned long l_width, l_height;
+	fit_size(l_image.getWidth(), l_image.getHeight(), max_size, l_width, l_height);
+	std::unique_ptr<DicomImage> l_scaled(l_image.createScaledImage(l_width, l_height, 1, 0));
+	if (!l_scaled || l_scaled->getStatus() != EIS_Normal)
+		return false;
+	if (l_scaled->isMonochrome())
+	{
+		// the file's own window when it has one, else its value range without outliers
+		if (l_scaled->getWindowCount() > 0)
+			l_scaled->setWindow(0);
+		else
+			l_scaled->setMinMaxWindow(1);
+	}
+
+	const unsigned char *l_data = (const unsigned char *)l_scaled->getOutputData(8, 0, 0);
+	if (l_data == NULL)
+		return false;
+	slice.width = (unsigned short)l_width;
+	slice.height = (unsigned short)l_height;
+	slice.sample_num = l_scaled->isMonochrome() ? 1 : 3;
+	slice.slice_num = 1;
+	slice.pixels.assign(l_data, l_data + l_scaled->getOutputDataSize(8));
+	return slice.pixels.size() == (size_t)l_width * l_height * slice.sample_num;
+}
+
+// protected
+
+// private
+void DicomPreviewLoader::render_loop()
+{
+	while (true)
+	{
+		RenderJob l_job;
+		std::shared_ptr<PendingPreview> l_pending;
+		{
+			std::unique_lock<std::mutex> l_lock(m_mutex);
+			m_job_cv.wait(l_lock, [this]() { return !m_jobs.empty() || m_stopped; });
+			if (m_stopped)
+				return;
+			l_job = m_jobs.front();
+			m_jobs.pop_front();
+			l_pending = m_pending[l_job.key];
+		}
+
+		DicomPreview l_slice;
+		if (!render_slice(l_job.source, l_pending->max_size, l_slice))
+			l_slice.pixels.clear();
+		{
+			std::lock_guard<std::mutex> l_lock(m_mutex);
+			l_pending->slices[l_job.slot] = std::move(l_slice);
+			if (--l_pending->remaining > 0)
+				continue;
+		}
+
+		// the last slice of the preview assembles it
+		DicomPreview l_preview;
+		if (assemble(*l_pending, l_preview))
+			DicomPreviewCache::get_instance()->put(l_job.key, std::move(l_preview));
+		else
+			std::cout << "No preview for " << l_job.source.file_path << std::endl;
+		{
+			std::lock_guard<std::mutex> l_lock(m_mutex);
+			m_pending.erase(l_job.key);
+		}
+		m_done_cv.notify_all();
+	}
+}
+
+bool DicomPreviewLoader::assemble(PendingPreview &pending, DicomPreview &preview)
+{
+	// slices that failed or differ from the first readable one are left out
+	preview.slice_num = 0;
+	for (int i = 0; i < pending.slices.size(); ++i)
+	{
+		DicomPreview &l_slice = pending.slices[i];
+		if (l_slice.pixels.empty())
+			continue;
+		if (preview.slice_num == 0)
+		{
+			preview.width = l_slice.width;
+			preview.height = l_slice.height;
+			preview.sample_num = l_slice.sample_num;
+		}
+		else if (l_slice.width != preview.width || l_slice.height != preview.height ||
+			l_slice.sample_num != preview.sample_num)
+			continue;
+		preview.pixels.insert(preview.pixels.end(), l_slice.pixels.begin(), l_slice.pixels.end());
+		++preview.slice_num;
+	}
+	return preview.slice_num > 0;
+}
+
+bool DicomPreviewLoader::render_j2k(const DicomPreviewSource &source, int max_size, DicomPreview &slice)
+{
+	DcmFileFormat l_file_format;
+	if (l_file_format.loadFile(source.file_path.c_str()).bad())
+		return false;
+	DcmDataset *l_dataset = l_file_format.getDataset();
+	if (!DicomJ2kDecoder::is_j2k(l_dataset->getOriginalXfer()))
+		return false;
+
+	Uint16 l_rows = 0, l_columns = 0, l_bits_allocated = 0, l_samples_per_pixel = 1;
+	Uint16 l_planar_configuration = 0, l_pixel_representation = 0;
+	Sint32 l_frame_count = 1;
+	l_dataset->findAndGetUint16(DCM_Rows, l_rows);
+	l_dataset->findAndGetUint16(DCM_Columns, l_columns);
+	l_dataset->findAndGetUint16(DCM_BitsAllocated, l_bits_allocated);
+	l_dataset->findAndGetUint16(DCM_SamplesPerPixel, l_samples_per_pixel);
+	l_dataset->findAndGetUint16(DCM_PlanarConfiguration, l_planar_configuration);
+	l_dataset->findAndGetUint16(DCM_PixelRepresentation, l_pixel_representation);
+	l_dataset->findAndGetSint32(DCM_NumberOfFrames, l_frame_count);
+	OFString l_photometric;
+	l_dataset->findAndGetOFString(DCM_PhotometricInterpretation, l_photometric);
+	if (l_rows == 0 || l_columns == 0 || (l_bits_allocated != 8 && l_bits_allocated != 16))
+		return false;
+
+	DicomJ2kDecoder l_decoder;
+	if (!l_decoder.open(l_dataset, std::max((int)l_frame_count, 1)) || source.frame_idx >= l_decoder.frame_num())
+		return false;
+	const size_t l_pixel_num = (size_t)l_rows * l_columns;
+	const int l_sample_num = l_samples_per_pixel == 3 ? 3 : 1;
+	std::vector<unsigned char> l_frame(l_pixel_num * l_sample_num * (l_bits_allocated / 8));
+	if (!l_decoder.decode_frame(source.frame_idx, l_frame.data(), l_frame.size(),
+		l_bits_allocated, l_sample_num, l_planar_configuration))
+		return false;
+
+	auto l_value = [&](size_t pixel, int sample) -> float
+	{
+		size_t l_idx = l_planar_configuration == 1 ? sample * l_pixel_num + pixel : pixel * l_sample_num + sample;
+		if (l_bits_allocated == 8)
+			return l_frame[l_idx];
+		const unsigned short *l_values = (const unsigned short *)l_frame.data();
+		return l_pixel_representation == 1 ? (float)(short)l_values[l_idx] : (float)l_values[l_idx];
+	};
+
+	// grey frames span their own value range, colour frames keep their 8 bit values
+	float l_min = 0.0f, l_max = 255.0f;
+	if (l_sample_num == 1)
+	{
+		l_min = l_max = l_value(0, 0);
+		for (size_t i = 1; i < l_pixel_num; ++i)
+		{
+			float l_v = l_value(i, 0);
+			l_min = std::min(l_min, l_v);
+			l_max = std::max(l_max, l_v);
+		}
+	}
+	else if (l_bits_allocated == 16)
+		l_max = 65535.0f;
+	const float l_scale = l_max > l_min ? 255.0f / (l_max - l_min) : 0.0f;
+	const bool l_invert = l_sample_num == 1 && l_photometric == "MONOCHROME1";
+
+	// box filter, every output pixel averages the source block it covers
+	unsigned long l_width, l_height;
+	fit_size(l_columns, l_rows, max_size, l_width, l_height);
+	slice.width = (unsigned short)l_width;
+	slice.height = (unsigned short)l_height;
+	slice.sample_num = l_sample_num;
+	slice.slice_num = 1;
+	slice.pixels.resize(l_width * l_height * l_sample_num);
+	for (unsigned long y = 0; y < l_height; ++y)
+	{
+		unsigned long l_y0 = y * l_rows / l_height, l_y1 = std::max((y + 1) * l_rows / l_height, l_y0 + 1);
+		for (unsigned long x = 0; x < l_width; ++x)
+		{
+			unsigned long l_x0 = x * l_columns / l_width, l_x1 = std::max((x + 1) * l_columns / l_width, l_x0 + 1);
+			for (int s = 0; s < l_sample_num; ++s)
+			{
+				float l_sum = 0.0f;
+				for (unsigned long sy = l_y0; sy < l_y1; ++sy)
+					for (unsigned long sx = l_x0; sx < l_x1; ++sx)
+						l_sum += l_value(sy * l_columns + sx, s);
+				float l_grey = (l_sum / ((l_y1 - l_y0) * (l_x1 - l_x0)) - l_min) * l_scale;
+				l_grey = std::min(std::max(l_grey, 0.0f), 255.0f);
+				slice.pixels[(y * l_width + x) * l_sample_num + s] = (unsigned char)(l_invert ? 255.0f - l_grey : l_grey);
+			}
+		}
+	}
+	return true;
+}
+
+void DicomPreviewLoader::fit_size(unsigned long width, unsigned long height, int max_size,
+	unsigned long &fit_width, unsigned long &fit_height)
+{
+	unsigned long l_long_side = std::max(width, height);
+	if (max_size <= 0 || l_long_side <= (unsigned long)max_size)
+	{
+		fit_width = width;
+		fit_height = height;
+		return;
+	}
+	fit_width = std::max(width * max_size / l_long_side, 1UL);
+	fit_height = std::max(height * max_size / l_long_side, 1UL);
+}
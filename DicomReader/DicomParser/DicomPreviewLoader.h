@@ -0,0 +1,77 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+// local
+struct DicomPreview;
+
+// One slice of a preview, frame_idx picks the frame of a multi frame file
+struct DicomPreviewSource
+{
+	std::string file_path;
+	int frame_idx;
+};
+
+/*!
+* \brief Renders series previews on a small worker pool
+* Every slice of a preview is its own job, read through DicomImage with
+* partial pixel access, scaled down with createScaledImage and windowed to
+* 8 bit, so the slices of one preview render side by side. JPEG 2000 files,
+* which dcmtk can not decode, go through DicomJ2kDecoder instead. The newest
+* request is rendered first, finished previews land in DicomPreviewCache.
+*/
+class DicomPreviewLoader
+{
+public:
+	// 0 picks up to 4 threads
+	DicomPreviewLoader(int thread_num);
+	~DicomPreviewLoader();
+
+	// Queue the slices of key unless it is cached or queued already
+	void request(const std::string &key, const std::vector<DicomPreviewSource> &sources, int max_size);
+	/*!
+	* \brief Wait until key is no longer being rendered
+	* timeout_ms < 0 waits forever. True once it is done, the preview is in the
+	* cache unless none of its slices could be read.
+	*/
+	bool wait(const std::string &key, int timeout_ms);
+
+	// Render one slice scaled to fit max_size into a single slice preview
+	static bool render_slice(const DicomPreviewSource &source, int max_size, DicomPreview &slice);
+
+protected:
+
+private:
+	struct PendingPreview
+	{
+		int max_size;
+		int remaining;
+		std::vector<DicomPreview> slices;
+	};
+	struct RenderJob
+	{
+		std::string key;
+		int slot;
+		DicomPreviewSource source;
+	};
+
+	std::map<std::string, std::shared_ptr<PendingPreview> > m_pending;
+	std::deque<RenderJob> m_jobs;
+	bool m_stopped;
+	std::mutex m_mutex;
+	std::condition_variable m_job_cv;
+	std::condition_variable m_done_cv;
+	std::vector<std::thread> m_workers;
+
+	void render_loop();
+	static bool assemble(PendingPreview &pending, DicomPreview &preview);
+	static bool render_j2k(const DicomPreviewSource &source, int max_size, DicomPreview &slice);
+	static void fit_size(unsigned long width, unsigned long height, int max_size,
+		unsigned long &fit_width, unsigned long &fit_height);
+};
@@ -0,0 +1,200 @@
+// dcmtk
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+// local
+#include "DicomDataMgr.h"
+#include "DicomDataParser.h"
+#include "DicomHeaderParser.h"
+// meta
+#include "DicomSeriesAssembler.h"
+// Cpp
+#include <algorithm>
+#include <iostream>
+
+// public
+DicomSeriesAssembler::DicomSeriesAssembler(DicomDataMgr *data_mgr, int thread_num) :
+	m_data_mgr(data_mgr),
+	m_slice_num(0),
+	m_pending_num(0),
+	m_stopped(false)
+{
+	thread_num = std::max(thread_num, 1);
+	for (int i = 0; i < thread_num; ++i)
+		m_workers.push_back(std::thread(&DicomSeriesAssembler::decode_loop, this));
+}
+
+DicomSeriesAssembler::~DicomSeriesAssembler()
+{
+	{
+		std::lock_guard<std::mutex> l_lock(m_job_mutex);
+		m_stopped = true;
+	}
+	m_job_cv.notify_all();
+	for (int i = 0; i < m_workers.size(); ++i)
+		m_workers[i].join();
+	for (DcmFileFormat *l_file_format : m_file_formats)
+		delete l_file_format;
+}
+
+bool DicomSeriesAssembler::add(DcmFileFormat *file_format, const std::string &file_path)
+{
+	// 1. register the header, the parser only reads the dataset
+	OFString l_sop;
+	file_format->getDataset()->findAndGetOFString(DCM_SOPInstanceUID, l_sop);
+	{
+		std::lock_guard<std::mutex> l_tree_lock(m_tree_mutex);
+		DicomHeaderParser l_header_parser(m_data_mgr);
+		if (l_sop.empty() || !l_header_parser.parse_header_info(file_path, file_format))
+		{
+			std::cout << "Received dataset not registered: " << file_path << std::endl;
+			delete file_format;
+			return false;
+		}
+		m_file_formats.insert(file_format);
+		++m_slice_num;
+
+		OFString l_series_uid;
+		file_format->getDataset()->findAndGetOFString(DCM_SeriesInstanceUID, l_series_uid);
+		auto l_inserted = m_series_progress.insert(std::make_pair(std::string(l_series_uid.c_str()), SeriesProgress()));
+		SeriesProgress &l_progress = l_inserted.first->second;
+		if (l_inserted.second)
+			l_progress.slice_num = 0;
+		++l_progress.slice_num;
+		l_progress.last_arrival = std::chrono::steady_clock::now();
+		l_progress.reported = false;
+
+		// 2. queue the pixel decode, still under the tree lock so flush() covers every registered slice
+		DecodeJob l_job;
+		l_job.file_format = file_format;
+		l_job.file_path = file_path;
+		l_job.sop = l_sop.c_str();
+		std::lock_guard<std::mutex> l_lock(m_job_mutex);
+		m_jobs.push_back(l_job);
+		++m_pending_num;
+	}
+	m_job_cv.notify_one();
+	return true;
+}
+
+void DicomSeriesAssembler::flush()
+{
+	std::unique_lock<std::mutex> l_lock(m_job_mutex);
+	m_idle_cv.wait(l_lock, [this]() { return m_pending_num == 0; });
+}
+
+int DicomSeriesAssembler::slice_num()
+{
+	std::lock_guard<std::mutex> l_tree_lock(m_tree_mutex);
+	return m_slice_num;
+}
+
+int DicomSeriesAssembler::decoded_num()
+{
+	std::lock_guard<std::mutex> l_lock(m_decoded_mutex);
+	return (int)m_decoded_slices.size();
+}
+
+void DicomSeriesAssembler::release(const std::vector<DcmFileFormat *> &file_formats, const std::vector<std::string> &sops)
+{
+	for (int i = 0; i < file_formats.size(); ++i)
+	{
+		if (m_file_formats.erase(file_formats[i]) > 0)
+			delete file_formats[i];
+	}
+	std::lock_guard<std::mutex> l_lock(m_decoded_mutex);
+	for (int i = 0; i < sops.size(); ++i)
+		m_decoded_slices.erase(sops[i]);
+}
+
+std::vector<std::string> DicomSeriesAssembler::take_complete_series(int settle_ms)
+{
+	std::vector<std::string> l_complete;
+	std::chrono::steady_clock::time_point l_now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> l_tree_lock(m_tree_mutex);
+	for (auto &l_item : m_series_progress)
+	{
+		SeriesProgress &l_progress = l_item.second;
+		if (l_progress.reported)
+			continue;
+		if (std::chrono::duration_cast<std::chrono::milliseconds>(l_now - l_progress.last_arrival).count() >= settle_ms)
+		{
+			l_progress.reported = true;
+			l_complete.push_back(l_item.first);
+		}
+	}
+	return l_complete;
+}
+
+bool DicomSeriesAssembler::get(const std::string &sop, float rescale_slope, float rescale_intercept,
+	short *buffer, size_t value_num)
+{
+	std::lock_guard<std::mutex> l_lock(m_decoded_mutex);
+	auto l_iter = m_decoded_slices.find(sop);
+	if (l_iter == m_decoded_slices.end() || l_iter->second.pixels.size() != value_num ||
+		l_iter->second.rescale_slope != rescale_slope || l_iter->second.rescale_intercept != rescale_intercept)
+		return false;
+	std::copy(l_iter->second.pixels.begin(), l_iter->second.pixels.end(), buffer);
+	return true;
+}
+
+// protected
+
+// private
+void DicomSeriesAssembler::decode_loop()
+{
+	while (true)
+	{
+		DecodeJob l_job;
+		{
+			std::unique_lock<std::mutex> l_lock(m_job_mutex);
+			m_job_cv.wait(l_lock, [this]() { return !m_jobs.empty() || m_stopped; });
+			if (m_stopped)
+				return;
+			l_job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+
+		DecodedSlice l_slice;
+		if (decode(l_job, l_slice))
+		{
+			std::lock_guard<std::mutex> l_lock(m_decoded_mutex);
+			m_decoded_slices[l_job.sop] = std::move(l_slice);
+		}
+
+		{
+			std::lock_guard<std::mutex> l_lock(m_job_mutex);
+			--m_pending_num;
+		}
+		m_idle_cv.notify_all();
+	}
+}
+
+bool DicomSeriesAssembler::decode(DecodeJob &job, DecodedSlice &slice)
+{
+	// the slice's own pixel module, the volume later checks the rescale against its series
+	DcmDataset *l_dataset = job.file_format->getDataset();
+	Uint16 l_rows = 0, l_columns = 0, l_bits_allocated = 0, l_samples_per_pixel = 1, l_planar_configuration = 0;
+	l_dataset->findAndGetUint16(DCM_Rows, l_rows);
+	l_dataset->findAndGetUint16(DCM_Columns, l_columns);
+	l_dataset->findAndGetUint16(DCM_BitsAllocated, l_bits_allocated);
+	l_dataset->findAndGetUint16(DCM_SamplesPerPixel, l_samples_per_pixel);
+	l_dataset->findAndGetUint16(DCM_PlanarConfiguration, l_planar_configuration);
+	OFString l_tmp_str;
+	std::string l_modality;
+	if (l_dataset->findAndGetOFString(DCM_Modality, l_tmp_str).good())
+		l_modality = l_tmp_str.c_str();
+	slice.rescale_slope = 1.0f;
+	slice.rescale_intercept = 0.0f;
+	if (l_dataset->findAndGetOFString(DCM_RescaleSlope, l_tmp_str).good())
+		slice.rescale_slope = (float)atof(l_tmp_str.c_str());
+	if (l_dataset->findAndGetOFString(DCM_RescaleIntercept, l_tmp_str).good())
+		slice.rescale_intercept = (float)atof(l_tmp_str.c_str());
+	if (l_rows == 0 || l_columns == 0)
+		return false;
+
+	std::string l_sample_num = l_samples_per_pixel == 3 ? "3" : "1";
+	slice.pixels.resize((size_t)l_rows * l_columns * (l_samples_per_pixel == 3 ? 3 : 1));
+	DicomDataParser l_data_parser;
+	return l_data_parser.get_data_slice(job.file_path, slice.pixels.data(), l_columns, l_rows, l_bits_allocated,
+		l_sample_num, l_modality, slice.rescale_slope, slice.rescale_intercept, l_planar_configuration, job.file_format);
+}
@@ -0,0 +1,110 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+// local
+class DicomDataMgr;
+class DcmFileFormat;
+
+/*!
+* \brief Builds series from datasets arriving one at a time
+* Every dataset is registered in the patient/study/series tree on the calling
+* thread and its pixels are decoded on worker threads right away, so a series
+* received over the network or copied into a watched folder is already
+* decoded when its last slice lands. DcmData takes the decoded slices by SOP
+* Instance UID when it assembles the volume.
+*/
+class DicomSeriesAssembler
+{
+public:
+	DicomSeriesAssembler(DicomDataMgr *data_mgr, int thread_num);
+	~DicomSeriesAssembler();
+
+	/*!
+	* \brief Register and queue one dataset, takes over file_format
+	* file_path is recorded as the slice file, it does not need to exist when
+	* the dataset came from memory. False when the header can not be parsed.
+	*/
+	bool add(DcmFileFormat *file_format, const std::string &file_path);
+	/*!
+	* \brief Blocks until every queued decode has finished
+	* add() registers and queues under tree_mutex(), so a caller holding it
+	* knows every slice in the tree is decoded once this returns.
+	*/
+	void flush();
+	/*!
+	* \brief Drop the datasets and decoded copies of slices taken into a volume
+	* Call with tree_mutex() held after flush(), the tree must no longer point at file_formats.
+	*/
+	void release(const std::vector<DcmFileFormat *> &file_formats, const std::vector<std::string> &sops);
+
+	int slice_num();
+	int decoded_num();
+
+	/*!
+	* \brief Series instance UIDs that became complete since the last call
+	* A series is complete when no slice arrived for settle_ms. Images in
+	* Acquisition counts one acquisition only and is not trusted for a series.
+	* A series that grows again afterwards is reported again.
+	*/
+	std::vector<std::string> take_complete_series(int settle_ms);
+
+	// Copy of a decoded slice, only when it was decoded with the same rescale
+	bool get(const std::string &sop, float rescale_slope, float rescale_intercept, short *buffer, size_t value_num);
+
+	// Held while the tree is read, add() waits on it before registering
+	std::mutex &tree_mutex() { return m_tree_mutex; }
+
+protected:
+
+private:
+	struct DecodeJob
+	{
+		DcmFileFormat *file_format;
+		std::string file_path;
+		std::string sop;
+	};
+	struct DecodedSlice
+	{
+		std::vector<short> pixels;
+		float rescale_slope;
+		float rescale_intercept;
+	};
+
+	struct SeriesProgress
+	{
+		int slice_num;
+		std::chrono::steady_clock::time_point last_arrival;
+		bool reported;
+	};
+
+	DicomDataMgr *m_data_mgr;
+	// keyed by series instance UID, guarded by m_tree_mutex
+	std::map<std::string, SeriesProgress> m_series_progress;
+	std::mutex m_tree_mutex;
+	// datasets stay alive until released, the tree records their pointers
+	std::unordered_set<DcmFileFormat *> m_file_formats;
+	int m_slice_num;
+
+	std::deque<DecodeJob> m_jobs;
+	int m_pending_num;
+	bool m_stopped;
+	std::mutex m_job_mutex;
+	std::condition_variable m_job_cv;
+	std::condition_variable m_idle_cv;
+	std::vector<std::thread> m_workers;
+
+	std::unordered_map<std::string, DecodedSlice> m_decoded_slices;
+	std::mutex m_decoded_mutex;
+
+	void decode_loop();
+	bool decode(DecodeJob &job, DecodedSlice &slice);
+};
@@ -1,12 +1,21 @@
 // meta
 #include "DicomSeriesData.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
 // public
 DicomSeriesData::DicomSeriesData() :
 	m_series_slice_thickness_good(false),
 	m_series_slice_thickness_validated(false),
+	m_KVP(0),
+	m_KVI(0),
+	m_largest_image_pixel_value(-1),
+	m_smallest_image_pixel_value(-1),
+	m_details_loaded(false),
+	m_instance_lookup_base(0),
+	m_slices_sorted(true),
 	/*m_image_file_lock(QReadWriteLock::Recursive),*/
 	m_series_plate_image(nullptr),
 	/*m_series_plate_lock(QReadWriteLock::Recursive),*/
@@ -27,16 +36,15 @@ bool DicomSeriesData::update_slice_thickness()
 {
 	if (!m_series_slice_thickness_validated)
 	{
-		/*m_image_file_lock.lockForRead();*/
-		for (auto iter = m_instance_number_to_idx_map.begin();
-			iter != m_instance_number_to_idx_map.end(); ++iter)
+		sort_slices();
+		m_image_file_lock.lock_shared();
+		int l_slice_num = m_sorted_slices.size();
+		for (int i = 0; i + 1 < l_slice_num; ++i)
 		{
-			int l_next_instance_num = iter->first + 1;
-			auto l_tmp_iter = m_instance_number_to_idx_map.find(l_next_instance_num);
-			if (l_tmp_iter != m_instance_number_to_idx_map.end())
+			int l_idx_1 = m_sorted_slices[i];
+			int l_idx_2 = m_sorted_slices[i + 1];
+			if (m_instance_numbers[l_idx_2] == m_instance_numbers[l_idx_1] + 1)
 			{
-				int l_idx_1 = iter->second;
-				int l_idx_2 = l_tmp_iter->second;
 				float l_location_1 = m_locations[l_idx_1];
 				float l_location_2 = m_locations[l_idx_2];
 				m_oriention_thickness = l_location_1 - l_location_2;
@@ -52,7 +60,130 @@ bool DicomSeriesData::update_slice_thickness()
 				break;
 			}
 		}
-		/*m_image_file_lock.unlock();*/
+		m_image_file_lock.unlock_shared();
 	}
 	return m_series_slice_thickness_good;
 }
+
+int DicomSeriesData::append_slice_record(const std::string &sop, unsigned int instance_num, float location,
+	int width, int height, const std::string &sample, int bit_allocate, int planar_configuration,
+	const std::string &overlay, const std::string &file_path, DcmFileFormat *file_format)
+{
+	int l_idx = m_image_files.size();
+	m_image_files.push_back(file_path);
+	m_locations.push_back(location);
+	m_image_file_formats.push_back(file_format);
+	m_instance_numbers.push_back(instance_num);
+	m_slice_widths.push_back(width);
+	m_slice_heights.push_back(height);
+	m_slice_bits_allocated.push_back(bit_allocate);
+	m_slice_planar_configurations.push_back(planar_configuration);
+	m_slice_sample_ids.push_back(intern_slice_string(sample));
+	m_slice_overlay_ids.push_back(intern_slice_string(overlay));
+	m_slice_sop_offsets.push_back(m_slice_sop_pool.size());
+	m_slice_sop_pool.append(sop.c_str(), sop.size() + 1);
+	m_slices_sorted = false;
+	return l_idx;
+}
+
+void DicomSeriesData::sort_slices()
+{
+	m_image_file_lock.lock();
+	if (m_slices_sorted)
+	{
+		m_image_file_lock.unlock();
+		return;
+	}
+
+	int l_total_num = m_image_files.size();
+	std::vector<int> l_order(l_total_num);
+	for (int i = 0; i < l_total_num; ++i)
+		l_order[i] = i;
+
+	// of slices sharing a sop the smallest file path wins, whatever the arrival order; slices without a sop are never duplicates
+	std::vector<bool> l_duplicate(l_total_num, false);
+	const char *l_pool = m_slice_sop_pool.c_str();
+	auto l_path_less = [this](int a, int b) {
+		int l_cmp = m_image_files[a].compare(m_image_files[b]);
+		return l_cmp != 0 ? l_cmp < 0 : a < b;
+	};
+	std::sort(l_order.begin(), l_order.end(), [&](int a, int b) {
+		int l_cmp = strcmp(l_pool + m_slice_sop_offsets[a], l_pool + m_slice_sop_offsets[b]);
+		return l_cmp != 0 ? l_cmp < 0 : l_path_less(a, b);
+	});
+	for (int i = 1; i < l_total_num; ++i)
+	{
+		const char *l_sop = l_pool + m_slice_sop_offsets[l_order[i]];
+		if (l_sop[0] != '\0' && strcmp(l_sop, l_pool + m_slice_sop_offsets[l_order[i - 1]]) == 0)
+			l_duplicate[l_order[i]] = true;
+	}
+
+	m_sorted_slices.clear();
+	for (int i = 0; i < l_total_num; ++i)
+	{
+		if (!l_duplicate[i])
+			m_sorted_slices.push_back(i);
+	}
+	// equal instance numbers are ordered by file path, so the bumping below does not depend on arrival order
+	std::sort(m_sorted_slices.begin(), m_sorted_slices.end(), [&](int a, int b) {
+		if (m_instance_numbers[a] != m_instance_numbers[b])
+			return m_instance_numbers[a] < m_instance_numbers[b];
+		return l_path_less(a, b);
+	});
+
+	// colliding instance numbers move on to the next free number
+	int l_slice_num = m_sorted_slices.size();
+	for (int i = 1; i < l_slice_num; ++i)
+	{
+		unsigned int &l_instance_num = m_instance_numbers[m_sorted_slices[i]];
+		unsigned int l_prev_instance_num = m_instance_numbers[m_sorted_slices[i - 1]];
+		if (l_instance_num <= l_prev_instance_num)
+			l_instance_num = l_prev_instance_num + 1;
+	}
+
+	// a direct lookup table while instance numbers are mostly contiguous, find_instance falls back to a binary search when sparse
+	m_instance_lookup.clear();
+	m_instance_lookup_base = 0;
+	if (l_slice_num > 0)
+	{
+		m_instance_lookup_base = m_instance_numbers[m_sorted_slices[0]];
+		size_t l_range = m_instance_numbers[m_sorted_slices[l_slice_num - 1]] - m_instance_lookup_base + 1;
+		if (l_range <= 4 * (size_t)l_slice_num + 64)
+		{
+			m_instance_lookup.assign(l_range, -1);
+			for (int i = 0; i < l_slice_num; ++i)
+				m_instance_lookup[m_instance_numbers[m_sorted_slices[i]] - m_instance_lookup_base] = m_sorted_slices[i];
+		}
+	}
+
+	m_slices_sorted = true;
+	m_image_file_lock.unlock();
+}
+
+int DicomSeriesData::find_instance(unsigned int instance_num) const
+{
+	if (m_sorted_slices.empty() || instance_num < m_instance_lookup_base)
+		return -1;
+	if (!m_instance_lookup.empty())
+	{
+		size_t l_pos = instance_num - m_instance_lookup_base;
+		return l_pos < m_instance_lookup.size() ? m_instance_lookup[l_pos] : -1;
+	}
+	auto l_iter = std::lower_bound(m_sorted_slices.begin(), m_sorted_slices.end(), instance_num,
+		[&](int idx, unsigned int value) { return m_instance_numbers[idx] < value; });
+	if (l_iter != m_sorted_slices.end() && m_instance_numbers[*l_iter] == instance_num)
+		return *l_iter;
+	return -1;
+}
+
+// private
+unsigned short DicomSeriesData::intern_slice_string(const std::string &str)
+{
+	auto l_iter = m_slice_string_ids.find(str);
+	if (l_iter != m_slice_string_ids.end())
+		return l_iter->second;
+	unsigned short l_id = m_slice_strings.size();
+	m_slice_strings.push_back(str);
+	m_slice_string_ids.insert(std::make_pair(str, l_id));
+	return l_id;
+}
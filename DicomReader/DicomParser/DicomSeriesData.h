@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <shared_mutex>
 // local
 class DicomSeriesPlateImage;
 // meta
@@ -110,24 +111,33 @@ public:
 	std::string m_overlay_origin;
 	int m_overlay_row_ori;      //ڼ¼Ӳʵ
 	int m_overlay_column_ori;
+	bool m_details_loaded;      //ģʽɨʱֻȡ齨Ҫıǩ
 
+	// : ɨ赽˳ŵĲ, ±꼴 idx
 	std::vector<std::string> m_image_files;
 	std::vector<float> m_locations;
     //std::vector<QByteArray*> m_image_byte_arrays;
     std::vector<DcmFileFormat*> m_image_file_formats;
-	std::map<unsigned int, int> m_instance_number_to_idx_map;
-	std::map<unsigned int, int> m_idx_to_instance_number_map;
-	std::map<unsigned int, int> m_idx_to_data_pos_map;
-	std::map<unsigned int, std::string> m_instance_number_to_overlay_map;
-	std::map<std::string, unsigned int> m_sop_to_instance_number_map;
-	std::map<unsigned int, int> m_instance_number_to_width_map;
-	std::map<unsigned int, int> m_instance_number_to_height_map;
-	std::map<unsigned int, int> m_instance_number_to_planarConfiguration_map;
-	std::map<unsigned int, std::string> m_instance_number_to_sample_map;
-	std::map<unsigned int, int> m_instance_number_to_bit_allocate_map;
+	std::vector<unsigned int> m_instance_numbers;    //sort_slices ֮Ϊȥغձ
+	std::vector<unsigned short> m_slice_widths;
+	std::vector<unsigned short> m_slice_heights;
+	std::vector<unsigned short> m_slice_bits_allocated;
+	std::vector<unsigned short> m_slice_planar_configurations;
+	std::vector<unsigned short> m_slice_sample_ids;  //m_slice_strings ±
+	std::vector<unsigned short> m_slice_overlay_ids;
+	std::vector<unsigned int> m_slice_sop_offsets;   //m_slice_sop_pool  '\0' βʼλ
+	std::string m_slice_sop_pool;
+	std::vector<std::string> m_slice_strings;        //פ sample/overlay ַ
+	std::map<std::string, unsigned short> m_slice_string_ids;
+
+	// sort_slices һ:  instance number  idx, Լ instance number  idx ֱӲұ
+	std::vector<int> m_sorted_slices;
+	std::vector<int> m_instance_lookup;
+	unsigned int m_instance_lookup_base;
+	bool m_slices_sorted;
 	//std::map<unsigned int, int> m_instance_number_to_winwidth_map;
 	//std::map<unsigned int, int> m_instance_number_to_wincenter_map;
-	/*QReadWriteLock m_image_file_lock;*/
+	std::shared_timed_mutex m_image_file_lock;
 
 	DicomSeriesPlateImage *m_series_plate_image;
 	/*QReadWriteLock m_series_plate_lock;*/
@@ -137,4 +147,29 @@ public:
 	~DicomSeriesData();
 
 	bool update_slice_thickness();
+
+	/*!
+	* \brief ׷һ, ÷ m_image_file_lock д
+	* ظ sop ͻ instance number  sort_slices ͳһ
+	*/
+	int append_slice_record(const std::string &sop, unsigned int instance_num, float location,
+		int width, int height, const std::string &sample, int bit_allocate, int planar_configuration,
+		const std::string &overlay, const std::string &file_path, DcmFileFormat *file_format);
+	/*!
+	* \brief ɨһ: ȥظ sop, ͻ instance number ˳, ұ
+	*/
+	void sort_slices();
+
+	// ²ѯҪ sort_slices
+	inline int slice_num() const { return (int)m_sorted_slices.size(); }
+	//  order  instance  idx
+	inline int sorted_slice(int order) const { return m_sorted_slices[order]; }
+	// instance number Ӧ idx, ڷ -1
+	int find_instance(unsigned int instance_num) const;
+	inline const char *slice_sop(int idx) const { return m_slice_sop_pool.c_str() + m_slice_sop_offsets[idx]; }
+	inline const std::string &slice_sample(int idx) const { return m_slice_strings[m_slice_sample_ids[idx]]; }
+	inline const std::string &slice_overlay(int idx) const { return m_slice_strings[m_slice_overlay_ids[idx]]; }
+
+private:
+	unsigned short intern_slice_string(const std::string &str);
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+// Cpp
+#include <cstdio>
+#include <cstring>
+// meta
+#include "DicomSliceCache.h"
+
+// public
+DicomSliceCache *DicomSliceCache::get_instance()
+{
+	static DicomSliceCache ls_instance;
+	return &ls_instance;
+}
+
+void DicomSliceCache::set_max_bytes(size_t max_bytes)
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_max_bytes = max_bytes;
+	evict_to(m_max_bytes);
+}
+
+bool DicomSliceCache::get(const std::string &sop, float rescale_slope, float rescale_intercept,
+	short *dst, size_t value_num)
+{
+	if (!enabled() || sop.empty())
+		return false;
+	std::string l_key = make_key(sop, rescale_slope, rescale_intercept);
+
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	auto l_iter = m_key_to_entry.find(l_key);
+	if (l_iter == m_key_to_entry.end() || l_iter->second->values.size() != value_num)
+	{
+		++m_miss_num;
+		return false;
+	}
+	m_entries.splice(m_entries.begin(), m_entries, l_iter->second);
+	memcpy(dst, l_iter->second->values.data(), value_num * sizeof(short));
+	++m_hit_num;
+	return true;
+}
+
+void DicomSliceCache::put(const std::string &sop, float rescale_slope, float rescale_intercept,
+	const short *src, size_t value_num)
+{
+	size_t l_bytes = value_num * sizeof(short);
+	if (!enabled() || sop.empty() || l_bytes > m_max_bytes)
+		return;
+	std::string l_key = make_key(sop, rescale_slope, rescale_intercept);
+
+	// the copy is made outside the lock, decode threads only serialize on the list update
+	Entry l_entry;
+	l_entry.key = l_key;
+	l_entry.values.assign(src, src + value_num);
+
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	if (l_bytes > m_max_bytes)
+		return;
+	auto l_iter = m_key_to_entry.find(l_key);
+	if (l_iter != m_key_to_entry.end())
+	{
+		m_used_bytes -= l_iter->second->values.size() * sizeof(short);
+		m_entries.erase(l_iter->second);
+		m_key_to_entry.erase(l_iter);
+	}
+	evict_to(m_max_bytes - l_bytes);
+	m_entries.push_front(std::move(l_entry));
+	m_key_to_entry[l_key] = m_entries.begin();
+	m_used_bytes += l_bytes;
+}
+
+void DicomSliceCache::clear()
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_entries.clear();
+	m_key_to_entry.clear();
+	m_used_bytes = 0;
+}
+
+DicomSliceCache::Stats DicomSliceCache::stats()
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	Stats l_stats;
+	l_stats.hit_num = m_hit_num;
+	l_stats.miss_num = m_miss_num;
+	l_stats.eviction_num = m_eviction_num;
+	l_stats.entry_num = m_entries.size();
+	l_stats.used_bytes = m_used_bytes;
+	l_stats.max_bytes = m_max_bytes;
+	return l_stats;
+}
+
+void DicomSliceCache::reset_stats()
+{
+	std::lock_guard<std::mutex> l_lock(m_mutex);
+	m_hit_num = 0;
+	m_miss_num = 0;
+	m_eviction_num = 0;
+}
+
+// protected
+
+// private
+DicomSliceCache::DicomSliceCache() :
+	m_max_bytes(0),
+	m_used_bytes(0),
+	m_hit_num(0),
+	m_miss_num(0),
+	m_eviction_num(0)
+{
+}
+
+std::string DicomSliceCache::make_key(const std::string &sop, float rescale_slope, float rescale_intercept)
+{
+	// the exact bit patterns, two series rescaled differently never share an entry
+	unsigned int l_slope_bits, l_intercept_bits;
+	memcpy(&l_slope_bits, &rescale_slope, sizeof(float));
+	memcpy(&l_intercept_bits, &rescale_intercept, sizeof(float));
+	char l_suffix[24];
+	snprintf(l_suffix, sizeof(l_suffix), "|%08x|%08x", l_slope_bits, l_intercept_bits);
+	return sop + l_suffix;
+}
+
+void DicomSliceCache::evict_to(size_t max_bytes)
+{
+	while (m_used_bytes > max_bytes && !m_entries.empty())
+	{
+		Entry &l_entry = m_entries.back();
+		m_used_bytes -= l_entry.values.size() * sizeof(short);
+		m_key_to_entry.erase(l_entry.key);
+		m_entries.pop_back();
+		++m_eviction_num;
+	}
+}
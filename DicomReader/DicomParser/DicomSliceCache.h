@@ -0,0 +1,66 @@
+#pragma once
+// Cpp
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+/*!
+* \brief Process wide LRU cache of decoded, rescaled slices
+* Entries are keyed by SOP Instance UID plus the rescale slope/intercept the
+* slice was converted with, so reopening a series or an overlapping subset
+* skips the file and the codec. The byte budget is 0 (disabled) until set.
+*/
+class DicomSliceCache
+{
+public:
+	struct Stats
+	{
+		uint64_t hit_num;
+		uint64_t miss_num;
+		uint64_t eviction_num;
+		size_t entry_num;
+		size_t used_bytes;
+		size_t max_bytes;
+	};
+
+	static DicomSliceCache *get_instance();
+
+	void set_max_bytes(size_t max_bytes);
+	bool enabled() const { return m_max_bytes != 0; }
+
+	// Copies value_num shorts of a cached slice into dst, false on a miss
+	bool get(const std::string &sop, float rescale_slope, float rescale_intercept,
+		short *dst, size_t value_num);
+	void put(const std::string &sop, float rescale_slope, float rescale_intercept,
+		const short *src, size_t value_num);
+	void clear();
+	Stats stats();
+	void reset_stats();
+
+protected:
+
+private:
+	struct Entry
+	{
+		std::string key;
+		std::vector<short> values;
+	};
+
+	std::list<Entry> m_entries;   // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> m_key_to_entry;
+	std::mutex m_mutex;
+	std::atomic<size_t> m_max_bytes;
+	size_t m_used_bytes;
+	uint64_t m_hit_num;
+	uint64_t m_miss_num;
+	uint64_t m_eviction_num;
+
+	DicomSliceCache();
+
+	static std::string make_key(const std::string &sop, float rescale_slope, float rescale_intercept);
+	void evict_to(size_t max_bytes);
+};
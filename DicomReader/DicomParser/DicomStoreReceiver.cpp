@@ -0,0 +1,117 @@
+// dcmtk
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/ofstd/ofstd.h>
+// meta
+#include "DicomStoreReceiver.h"
+// Cpp
+#include <iostream>
+
+#ifdef _WIN32
+static const char gs_separator = '\\';
+#else
+static const char gs_separator = '/';
+#endif
+
+// public
+DicomStoreReceiver::DicomStoreReceiver(int port, const std::string &ae_title, const std::string &store_dir,
+	const DatasetCallback &on_dataset, const std::function<void()> &on_association_end) :
+	m_store_dir(store_dir),
+	m_on_dataset(on_dataset),
+	m_on_association_end(on_association_end),
+	m_stop(false)
+{
+	OFStandard::initializeNetwork();
+
+	DcmSCPConfig &l_config = getConfig();
+	l_config.setPort((Uint16)port);
+	l_config.setAETitle(ae_title.c_str());
+	l_config.setHostLookupEnabled(false);
+	// a short accept timeout lets listen() notice stop() between associations
+	l_config.setConnectionBlockingMode(DUL_NOBLOCK);
+	l_config.setConnectionTimeout(1);
+
+	// uncompressed first, then every syntax the codec registry and OpenJPEG decode
+	OFList<OFString> l_xfers;
+	l_xfers.push_back(UID_LittleEndianExplicitTransferSyntax);
+	l_xfers.push_back(UID_BigEndianExplicitTransferSyntax);
+	l_xfers.push_back(UID_LittleEndianImplicitTransferSyntax);
+	l_xfers.push_back(UID_JPEGProcess14SV1TransferSyntax);
+	l_xfers.push_back(UID_JPEGProcess14TransferSyntax);
+	l_xfers.push_back(UID_JPEGProcess1TransferSyntax);
+	l_xfers.push_back(UID_JPEGProcess2_4TransferSyntax);
+	l_xfers.push_back(UID_JPEGLSLosslessTransferSyntax);
+	l_xfers.push_back(UID_JPEGLSLossyTransferSyntax);
+	l_xfers.push_back(UID_JPEG2000LosslessOnlyTransferSyntax);
+	l_xfers.push_back(UID_JPEG2000TransferSyntax);
+	l_xfers.push_back(UID_RLELosslessTransferSyntax);
+	for (int i = 0; i < numberOfDcmAllStorageSOPClassUIDs; ++i)
+		l_config.addPresentationContext(dcmAllStorageSOPClassUIDs[i], l_xfers);
+
+	OFList<OFString> l_echo_xfers;
+	l_echo_xfers.push_back(UID_LittleEndianExplicitTransferSyntax);
+	l_echo_xfers.push_back(UID_LittleEndianImplicitTransferSyntax);
+	l_config.addPresentationContext(UID_VerificationSOPClass, l_echo_xfers);
+}
+
+DicomStoreReceiver::~DicomStoreReceiver()
+{
+}
+
+// protected
+OFCondition DicomStoreReceiver::handleIncomingCommand(T_DIMSE_Message *incomingMsg, const DcmPresentationContextInfo &presInfo)
+{
+	if (incomingMsg->CommandField != DIMSE_C_STORE_RQ)
+		return DcmSCP::handleIncomingCommand(incomingMsg, presInfo);
+
+	T_DIMSE_C_StoreRQ &l_request = incomingMsg->msg.CStoreRQ;
+	DcmDataset *l_dataset = NULL;
+	OFCondition l_status = receiveSTORERequest(l_request, presInfo.presentationContextID, l_dataset);
+	if (l_status.bad())
+	{
+		delete l_dataset;
+		std::cout << "C-STORE receive failed: " << l_status.text() << std::endl;
+		return l_status;
+	}
+
+	// the file format takes the dataset over, the meta header is filled in on save
+	DcmFileFormat *l_file_format = new DcmFileFormat(l_dataset, OFFalse);
+	std::string l_file_path;
+	if (!m_store_dir.empty())
+	{
+		l_file_path = m_store_dir;
+		if (l_file_path.back() != '\\' && l_file_path.back() != '/')
+			l_file_path += gs_separator;
+		l_file_path += std::string(l_request.AffectedSOPInstanceUID) + ".dcm";
+		if (l_file_format->saveFile(l_file_path.c_str(), l_dataset->getOriginalXfer()).bad())
+		{
+			std::cout << "C-STORE save failed: " << l_file_path << std::endl;
+			l_file_path.clear();
+		}
+	}
+
+	// answer first, the callback registers and queues the decode without blocking the sender long
+	l_status = sendSTOREResponse(presInfo.presentationContextID, l_request, STATUS_Success);
+	m_on_dataset(l_file_format, l_file_path);
+	return l_status;
+}
+
+void DicomStoreReceiver::notifyAssociationTermination()
+{
+	DcmSCP::notifyAssociationTermination();
+	if (m_on_association_end)
+		m_on_association_end();
+}
+
+OFBool DicomStoreReceiver::stopAfterCurrentAssociation()
+{
+	return m_stop;
+}
+
+OFBool DicomStoreReceiver::stopAfterConnectionTimeout()
+{
+	return m_stop;
+}
+
+// private
@@ -0,0 +1,42 @@
+#pragma once
+// dcmtk
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmnet/scp.h>
+// Cpp
+#include <string>
+#include <atomic>
+#include <functional>
+
+/*!
+* \brief In-process C-STORE SCP
+* Accepts every storage SOP class in the transfer syntaxes the decoders
+* handle and hands each received dataset to a callback while the
+* association is still running, nothing waits for the transfer to finish.
+* listen() blocks, run it on its own thread and end it with stop().
+* Can be exercised locally with: storescu localhost <port> *.dcm
+*/
+class DicomStoreReceiver : public DcmSCP
+{
+public:
+	// Takes over file_format, file_path is empty when nothing was written to disk
+	typedef std::function<void(DcmFileFormat *file_format, const std::string &file_path)> DatasetCallback;
+
+	DicomStoreReceiver(int port, const std::string &ae_title, const std::string &store_dir,
+		const DatasetCallback &on_dataset, const std::function<void()> &on_association_end);
+	virtual ~DicomStoreReceiver();
+
+	// Leave listen() once the running association is over
+	void stop() { m_stop = true; }
+
+protected:
+	virtual OFCondition handleIncomingCommand(T_DIMSE_Message *incomingMsg, const DcmPresentationContextInfo &presInfo);
+	virtual void notifyAssociationTermination();
+	virtual OFBool stopAfterCurrentAssociation();
+	virtual OFBool stopAfterConnectionTimeout();
+
+private:
+	std::string m_store_dir;
+	DatasetCallback m_on_dataset;
+	std::function<void()> m_on_association_end;
+	std::atomic<bool> m_stop;
+};
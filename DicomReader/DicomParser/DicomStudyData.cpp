@@ -5,6 +5,7 @@
 
 // public
 DicomStudyData::DicomStudyData() :
+	m_details_loaded(false),
 	/*m_series_lock(QReadWriteLock::Recursive),*/
 	m_study_plate_image(nullptr),
 	/*m_study_plate_lock(QReadWriteLock::Recursive),*/
@@ -15,7 +16,7 @@ DicomStudyData::DicomStudyData() :
 
 void DicomStudyData::clear_data()
 {
-	/*m_series_lock.lockForWrite();*/
+	m_series_lock.lock();
 	int l_series_num = m_series.size();
 	for (int i = 0; i < l_series_num; ++i)
 	{
@@ -23,7 +24,7 @@ void DicomStudyData::clear_data()
 	}
 	m_series.clear();
 	m_series_ID_to_idx_map.clear();
-	/*m_series_lock.unlock();*/
+	m_series_lock.unlock();
 
 	/*m_study_plate_lock.lockForWrite();*/
 	if (m_study_plate_image != nullptr)
@@ -37,12 +38,12 @@ void DicomStudyData::clear_data()
 bool DicomStudyData::check_series_available(std::string &series_number, int &idx)
 {
 	bool l_ret = false;
-	/*m_series_lock.lockForRead();*/
+	m_series_lock.lock_shared();
 	auto l_iter = m_series_ID_to_idx_map.find(series_number);
 	l_ret = l_iter != m_series_ID_to_idx_map.end();
 	if (l_ret)
 		idx = l_iter->second;
-	/*m_series_lock.unlock();*/
+	m_series_lock.unlock_shared();
 	return l_ret;
 }
 
@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <shared_mutex>
 // local
 class DicomSeriesData;
 class DicomStudyPlateImage;
@@ -16,10 +17,11 @@ public:
 	std::string m_study_date;
 	std::string m_study_time;
 	std::string m_study_description;
+	bool m_details_loaded;
 
 	std::vector<DicomSeriesData *> m_series;
 	std::map<std::string, int> m_series_ID_to_idx_map;
-	/*QReadWriteLock m_series_lock;*/
+	std::shared_timed_mutex m_series_lock;
 
 	DicomStudyPlateImage *m_study_plate_image;
 	/*QReadWriteLock m_study_plate_lock;*/
@@ -1,19 +1,45 @@
-#include <vtkSmartPointer.h>
-#include <vtkDirectory.h>
+#include <omp.h>
+#include <algorithm>
+#include <climits>
+#include <sys/stat.h>
+#include <chrono>
+#include <future>
 
-#include <dcmtk/dcmdata/dcrledrg.h>
-#include <dcmtk/dcmjpeg/djdecode.h>
-#include <dcmtk/dcmjpeg/djencode.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcfcache.h>
 
 #define DLL_EXPORTS
 
 #include "DicomReader.h"
 
+#include "DicomParser/DicomCodecRegistry.h"
 #include "DicomParser/DicomDataParser.h"
+#include "DicomParser/DicomDirCrawler.h"
+#include "DicomParser/DicomDirIndex.h"
+#include "DicomParser/DicomFolderWatcher.h"
+#include "DicomParser/DicomFrameStream.h"
 #include "DicomParser/DicomHeaderParser.h"
+#include "DicomParser/DicomIndexCache.h"
+#include "DicomParser/DicomIoScheduler.h"
+#include "DicomParser/DicomJ2kDecoder.h"
 #include "DicomParser/DicomPatientData.h"
+#include "DicomParser/DicomPreviewCache.h"
+#include "DicomParser/DicomPreviewLoader.h"
 #include "DicomParser/DicomStudyData.h"
+#include "DicomParser/DicomSeriesAssembler.h"
 #include "DicomParser/DicomSeriesData.h"
+#include "DicomParser/DicomSliceCache.h"
+#include "DicomParser/DicomStoreReceiver.h"
+
+// Out of range values saturate rather than wrap around
+inline short clamp_to_short(float value) {
+	return (short)std::min(std::max(value, (float)SHRT_MIN), (float)SHRT_MAX);
+}
+
+inline short clamp_to_short(int value) {
+	return (short)std::min(std::max(value, (int)SHRT_MIN), (int)SHRT_MAX);
+}
 
 inline float ofstr_to_float(OFString &str) {
 	return static_cast<Float32>(atof((const char *)str.c_str()));
@@ -39,8 +65,16 @@ inline float *ofstr_to_float_array(OFString &str, int count) {
 	return l_ret_vec;
 }
 
-DcmData::DcmData(std::string dcm_path, bool dcm_multiFrame) {
-	if (dcm_multiFrame) {
+DcmData::DcmData(std::string dcm_path, bool dcm_multiFrame, DcmLoadOptions options)
+	: load_options(options), slice_num(0), volume_buf(nullptr), data_mgr(new DicomDataMgr()),
+	slice_ready_num(0), load_finished(false), load_cancelled(false), association_end_num(0), association_waited_num(0),
+	frame_stream_window(0), frame_stored_bits(0), frame_is_signed(false), frame_is_inverted(false) {
+	header_scan_stats.file_num = 0;
+	header_scan_stats.seconds = 0.0;
+	header_scan_stats.files_per_second = 0.0;
+	if (dcm_multiFrame && load_options.frame_window > 0) {
+		OpenFrameStream(dcm_path, load_options.frame_window);
+	} else if (dcm_multiFrame) {
 		LoadMultiFrameData(dcm_path);
 	} else {
 		LoadSingleFrameData(dcm_path);
@@ -48,65 +82,1020 @@ DcmData::DcmData(std::string dcm_path, bool dcm_multiFrame) {
 }
 
 DcmData::~DcmData() {
+	StopReceiver();
+	StopWatch();
+	load_cancelled = true;
+	if (load_thread.joinable())
+		load_thread.join();
+	ReleaseParsedFiles();
 	delete[] volume_buf;
+	delete data_mgr;
 }
 
 void DcmData::LoadSingleFrameData(std::string file_path) {
+	if (!ScanFolder(file_path) || !SelectSeries(load_options.series_index))
+		return;
+
+	if (load_options.decode_pixels) {
+		volume_buf = new short[img_width * img_height * slice_num];
+		DecodeSlices(volume_buf, img_width * img_height);
+	}
+}
+
+bool DcmData::OpenFrameStream(std::string file_path, int window_size) {
+	CloseFrameStream();
+	std::unique_ptr<DicomFrameStream> stream(new DicomFrameStream());
+	if (!stream->open(file_path, window_size) ||
+		!ReadMultiFrameHeader(stream->dataset(), frame_stored_bits, frame_is_signed, frame_is_inverted))
+		return false;
+	slice_num = stream->frame_num();
+	frame_stream_window = std::max(window_size, 1);
+	frame_stream = std::move(stream);
+	// The first frames are on their way before the first ReadFrame
+	frame_stream->prefetch(0, frame_stream_window);
+	return true;
+}
+
+bool DcmData::ReadFrame(int frame_idx, short *dst) {
+	if (!frame_stream)
+		return false;
+	std::shared_ptr<const DicomFrameStream::Frame> frame = frame_stream->frame(frame_idx);
+	// Playback runs forwards, keep the window filled ahead of the frame shown
+	frame_stream->prefetch(frame_idx + 1, frame_stream_window);
+	const size_t slice_pixel_num = (size_t)img_width * img_height;
+	if (!frame) {
+		std::fill(dst, dst + slice_pixel_num, 0);
+		return false;
+	}
+	ConvertFrame(frame->bytes.data(), dst, slice_pixel_num, img_bit_num, frame_stored_bits, frame_is_signed,
+		frame_is_inverted, img_sample_num == "3" ? 3 : 1, frame->planar_configuration);
+	return true;
+}
+
+void DcmData::CloseFrameStream() {
+	frame_stream.reset();
+}
+
+bool DcmData::ScanFolder(std::string file_path) {
+	// The running decode still reads the parsed files of the old scan
+	if ((load_thread.joinable() && !load_finished) || receive_thread.joinable() || folder_watcher)
+		return false;
+	WaitForLoad();
+
+	// A failed scan reports zeros rather than the numbers of the scan before
+	header_scan_stats.file_num = 0;
+	header_scan_stats.seconds = 0.0;
+	header_scan_stats.files_per_second = 0.0;
+	std::chrono::steady_clock::time_point scan_start = std::chrono::steady_clock::now();
+
 	folder_path = file_path;
+	file_names.clear();
+
+	// Files kept by an earlier scan point into the old tree
+	ReleaseParsedFiles();
+	data_mgr->clear_data();
+	series_assembler.reset();
+
+	std::vector<std::string> file_paths;
+	// Media exports are indexed from their DICOMDIR without parsing every image
+	std::string dicomdir_path = load_options.use_dicomdir ? DicomDirIndex::find_dicomdir(folder_path) : std::string();
+	if (!dicomdir_path.empty()) {
+		DicomHeaderParser header_parser(data_mgr);
+		header_parser.set_header_only(true);
+		if (load_options.geometry_only_header)
+			header_parser.set_profile(DicomHeaderParser::PROFILE_GEOMETRY);
+		DicomDirIndex dicomdir_index(data_mgr, load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads());
+		if (dicomdir_index.load(dicomdir_path, header_parser)) {
+			file_paths = dicomdir_index.file_paths();
+			data_mgr->sort_slices();
+		} else {
+			data_mgr->clear_data();
+			dicomdir_path.clear();
+		}
+	}
+
+	if (dicomdir_path.empty() && !load_options.index_cache_dir.empty()) {
+		// The index is keyed on the complete file list, so it is listed up front
+		std::vector<DicomCrawlEntry> entries;
+		if (!DicomDirCrawler::list(folder_path, load_options.recursive_scan, entries)) {
+			std::cerr << "Invalid directory!" << std::endl;
+			return false;
+		}
+		for (int i = 0; i < entries.size(); ++i)
+			file_paths.push_back(entries[i].file_path);
+
+		// An unchanged folder is rebuilt from its index without parsing any header
+		DicomIndexCache index_cache(load_options.index_cache_dir);
+		if (!index_cache.restore(folder_path, file_paths, data_mgr, !load_options.geometry_only_header)) {
+			size_t next_entry = 0;
+			file_paths.clear();
+			ParseHeaders([&entries, &next_entry](DicomCrawlEntry &entry) {
+				bool has_entry = false;
+#pragma omp critical(crawl_queue)
+				{
+					if (next_entry < entries.size()) {
+						entry = entries[next_entry++];
+						has_entry = true;
+					}
+				}
+				return has_entry;
+			}, file_paths);
+			data_mgr->sort_slices();
+			index_cache.store(folder_path, file_paths, data_mgr);
+		}
+	} else if (dicomdir_path.empty()) {
+		// Header parsing starts on the first files while the crawler is still listing
+		DicomDirCrawler crawler;
+		if (!crawler.start(folder_path, load_options.recursive_scan)) {
+			std::cerr << "Invalid directory!" << std::endl;
+			return false;
+		}
+		ParseHeaders([&crawler](DicomCrawlEntry &entry) { return crawler.next_file(entry); }, file_paths);
+		data_mgr->sort_slices();
+	}
+
+	// Names relative to the scanned folder, subfolders included
+	size_t prefix_length = folder_path.size();
+	if (prefix_length > 0 && folder_path.back() != '\\' && folder_path.back() != '/')
+		++prefix_length;
+	std::sort(file_paths.begin(), file_paths.end());
+	for (int i = 0; i < file_paths.size(); ++i)
+		file_names.push_back(file_paths[i].substr(std::min(prefix_length, file_paths[i].size())));
+
+	// DICOMDIR, restored index or parsed headers alike, timed over the whole scan
+	double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - scan_start).count();
+	header_scan_stats.file_num = (int)file_paths.size();
+	header_scan_stats.seconds = scan_seconds;
+	header_scan_stats.files_per_second = scan_seconds > 0.0 ? file_paths.size() / scan_seconds : 0.0;
+
+	if (data_mgr->m_patients.empty()) {
+		std::cerr << "No dicom series found in " << folder_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::vector<DcmSeriesInfo> DcmData::GetSeriesList() const {
+	std::vector<DcmSeriesInfo> series_list;
+	for (DicomPatientData *patient : data_mgr->m_patients) {
+		for (DicomStudyData *study : patient->m_studies) {
+			for (DicomSeriesData *series : study->m_series) {
+				DcmSeriesInfo info;
+				info.patient_ID = patient->m_patient_ID;
+				info.study_ID = study->m_study_ID;
+				info.series_number = series->m_series_number;
+				info.series_description = series->m_series_description;
+				info.modality = series->m_series_modality;
+				info.slice_num = series->slice_num();
+				info.width = series->m_resolution[0];
+				info.height = series->m_resolution[1];
+				series_list.push_back(info);
+			}
+		}
+	}
+	return series_list;
+}
+
+bool DcmData::LoadSeriesDetails(int series_idx) {
+	// Received trees keep growing, walk them under the tree lock
+	std::unique_lock<std::mutex> tree_lock;
+	if (series_assembler)
+		tree_lock = std::unique_lock<std::mutex>(series_assembler->tree_mutex());
+	if (series_idx < 0)
+		return false;
+	for (int p = 0; p < (int)data_mgr->m_patients.size(); ++p) {
+		DicomPatientData *patient = data_mgr->m_patients[p];
+		for (int s = 0; s < (int)patient->m_studies.size(); ++s) {
+			int study_series_num = (int)patient->m_studies[s]->m_series.size();
+			if (series_idx < study_series_num)
+				return data_mgr->load_details(p, s, series_idx);
+			series_idx -= study_series_num;
+		}
+	}
+	return false;
+}
+
+bool DcmData::SelectSeries(int series_idx) {
+	// The running decode writes with the old geometry
+	if (load_thread.joinable() && !load_finished)
+		return false;
+	WaitForLoad();
+
+	DicomSeriesData *series = FindSeries(series_idx);
+	if (series == nullptr || series->slice_num() == 0) {
+		std::cerr << "Invalid series index " << series_idx << std::endl;
+		return false;
+	}
+
+	slice_num = series->slice_num();
+	instance_number_to_idx_map.clear();
+	for (int i = 0; i < slice_num; ++i) {
+		int idx = series->sorted_slice(i);
+		instance_number_to_idx_map.insert(std::make_pair(series->m_instance_numbers[idx], idx));
+	}
+
+	// Slices are appended in whatever order the scan threads finish, compare
+	// the locations of the first two instances rather than the first two files
+	is_img_inverse = false;
+	if (slice_num > 1)
+		is_img_inverse = series->m_locations[series->sorted_slice(0)] < series->m_locations[series->sorted_slice(1)];
+	img_pixel_spacing[0] = series->m_pixel_spacing[0];
+	img_pixel_spacing[1] = series->m_pixel_spacing[1];
+	series->update_slice_thickness();
+	img_slice_thickness = series->m_series_slice_thickness;
+	img_width = series->m_resolution[0];
+	img_height = series->m_resolution[1];
+	img_bit_num = series->m_bits_allocated;
+	img_sample_num = series->m_samples_per_pixel;
+	img_modality = series->m_series_modality;
+	img_rescale_slope = series->m_rescale_slope;
+	img_rescale_intercept = series->m_rescale_intercept;
+	img_planar_configuration = atoi(series->m_planar_configuration.c_str());
+
+	// Resolve the slice order up front, the decode workers must not touch the map.
+	// Parsed files are gone after a decode, the series still points at them then.
+	slice_files.clear();
+	slice_sops.clear();
+	{
+		std::lock_guard<std::mutex> lock(slice_layout_mutex);
+		slice_layout_keys.clear();
+	}
+	slice_file_formats.clear();
+	for (int i = 0; i < slice_num; ++i) {
+		int idx = series->sorted_slice(i);
+		slice_files.push_back(series->m_image_files[idx]);
+		slice_sops.push_back(series->slice_sop(idx));
+		slice_file_formats.push_back(parsed_files.empty() && !series_assembler ? nullptr : series->m_image_file_formats[idx]);
+	}
+
+	delete[] volume_buf;
+	volume_buf = nullptr;
+	ResetSliceReady();
+	return true;
+}
 
-	vtkSmartPointer<vtkDirectory> directory = vtkSmartPointer<vtkDirectory>::New();
-	int opened = directory->Open(folder_path.c_str());
-	if (!opened) {
-		std::cerr << "Invalid directory!" << std::endl;
+bool DcmData::DecodeSlices(short *dst, size_t slice_stride) {
+	std::vector<int> volume_order(slice_num);
+	for (int i = 0; i < slice_num; ++i)
+		volume_order[i] = i;
+	if (load_options.physical_read_order)
+		SortByPhysicalLayout(volume_order);
+	return DecodeSlicesInOrder(dst, slice_stride, volume_order);
+}
+
+bool DcmData::DecodeSlab(int first_slice, int slice_count, short *dst, size_t slice_stride) {
+	if (dst == nullptr || slice_files.empty() || first_slice < 0 || slice_count <= 0 || first_slice + slice_count > slice_num)
+		return false;
+	std::vector<int> volume_order(slice_count);
+	for (int i = 0; i < slice_count; ++i)
+		volume_order[i] = first_slice + i;
+	if (load_options.physical_read_order)
+		SortByPhysicalLayout(volume_order);
+	return DecodeSliceList(dst, slice_stride, volume_order, first_slice, false) == 0;
+}
+
+bool DcmData::ForEachSlab(int slab_slices, const std::function<bool(const short *, int, int)> &consumer) {
+	// A background load would decode the parsed files a second time
+	if (slice_files.empty() || slab_slices <= 0 || (load_thread.joinable() && !load_finished))
+		return false;
+	const size_t slice_stride = img_width * img_height;
+	slab_slices = std::min(slab_slices, slice_num);
+
+	// Two slab buffers: the next slab decodes while the consumer works on this one
+	std::vector<short> slab_bufs[2];
+	slab_bufs[0].resize(slab_slices * slice_stride);
+	slab_bufs[1].resize(slab_slices * slice_stride);
+	auto decode_slab = [this, slab_slices, slice_stride](int first_slice, short *dst) {
+		return DecodeSlab(first_slice, std::min(slab_slices, slice_num - first_slice), dst, slice_stride);
+	};
+
+	bool all_decoded = true;
+	int cur = 0;
+	std::future<bool> next_slab = std::async(std::launch::async, decode_slab, 0, slab_bufs[cur].data());
+	for (int first_slice = 0; first_slice < slice_num; first_slice += slab_slices) {
+		all_decoded = next_slab.get() && all_decoded;
+		int next_first_slice = first_slice + slab_slices;
+		if (next_first_slice < slice_num)
+			next_slab = std::async(std::launch::async, decode_slab, next_first_slice, slab_bufs[1 - cur].data());
+		if (!consumer(slab_bufs[cur].data(), first_slice, std::min(slab_slices, slice_num - first_slice))) {
+			if (next_slab.valid())
+				next_slab.wait();
+			break;
+		}
+		cur = 1 - cur;
+	}
+
+	// Each slice was visited once, the parsed files are spent
+	ReleaseParsedFiles();
+	return all_decoded;
+}
+
+void DcmData::SetSliceCacheBudget(size_t max_bytes) {
+	DicomSliceCache::get_instance()->set_max_bytes(max_bytes);
+}
+
+DcmSliceCacheStats DcmData::GetSliceCacheStats() {
+	DicomSliceCache::Stats cache_stats = DicomSliceCache::get_instance()->stats();
+	DcmSliceCacheStats stats;
+	stats.hit_num = cache_stats.hit_num;
+	stats.miss_num = cache_stats.miss_num;
+	stats.eviction_num = cache_stats.eviction_num;
+	stats.entry_num = cache_stats.entry_num;
+	stats.used_bytes = cache_stats.used_bytes;
+	stats.max_bytes = cache_stats.max_bytes;
+	return stats;
+}
+
+DcmHeaderScanStats DcmData::GetHeaderScanStats() const {
+	return header_scan_stats;
+}
+
+bool DcmData::BenchmarkDecode(std::string dcm_path, bool dcm_multiFrame, DcmDecodeBenchmark &result,
+	int thread_num, int repeat) {
+	result.transfer_syntax.clear();
+	result.frame_num = 0;
+	result.seconds = result.frames_per_second = result.mb_per_second = 0.0;
+
+	DcmLoadOptions options;
+	options.thread_num = thread_num;
+	options.decode_pixels = false;
+	// Cached slices would skip the codec from the second pass on
+	options.bypass_slice_cache = true;
+
+	std::string sample_file = dcm_path;
+	double best_seconds = 0.0;
+	int frame_num = 0;
+	size_t frame_bytes = 0;
+	for (int r = 0; r < std::max(repeat, 1); ++r) {
+		double seconds = 0.0;
+		if (dcm_multiFrame) {
+			// The whole file is read and decoded by the constructor
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			DcmData data(dcm_path, true, options);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			frame_num = data.volume_buf != nullptr ? data.slice_num : 0;
+			frame_bytes = (size_t)data.img_width * data.img_height * 2;
+		} else {
+			// The header pass is left out, only file reads and decoding are timed
+			DcmData data(dcm_path, false, options);
+			if (data.slice_num <= 0)
+				break;
+			std::vector<short> volume((size_t)data.img_width * data.img_height * data.slice_num);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bool decoded = data.DecodeSlices(volume.data(), (size_t)data.img_width * data.img_height);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			frame_num = decoded ? data.slice_num : 0;
+			frame_bytes = (size_t)data.img_width * data.img_height * 2;
+			sample_file = data.slice_files[0];
+		}
+		if (frame_num == 0)
+			break;
+		if (r == 0 || seconds < best_seconds)
+			best_seconds = seconds;
+	}
+	if (frame_num == 0) {
+		std::cerr << "Decode benchmark failed: " << dcm_path << std::endl;
+		return false;
+	}
+
+	DcmFileFormat fileformat;
+	fileformat.loadFileUntilTag(sample_file.c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+	DcmXfer xfer(fileformat.getDataset()->getOriginalXfer());
+	double decoded_mb = (double)frame_bytes * frame_num / (1024.0 * 1024.0);
+	result.transfer_syntax = xfer.getXferName();
+	result.frame_num = frame_num;
+	result.seconds = best_seconds;
+	result.frames_per_second = best_seconds > 0.0 ? frame_num / best_seconds : 0.0;
+	result.mb_per_second = best_seconds > 0.0 ? decoded_mb / best_seconds : 0.0;
+	return true;
+}
+
+bool DcmData::StartReceiver(int port, std::string ae_title, std::string store_dir) {
+	if (receive_thread.joinable() || (load_thread.joinable() && !load_finished))
+		return false;
+	WaitForLoad();
+	BeginIngest(store_dir);
+	{
+		std::lock_guard<std::mutex> lock(association_mutex);
+		association_end_num = 0;
+		association_waited_num = 0;
+	}
+
+	store_receiver.reset(new DicomStoreReceiver(port, ae_title, store_dir,
+		[this](DcmFileFormat *file_format, const std::string &file_path) {
+			// Without a store folder the SOP Instance UID stands in for the file
+			OFString sop;
+			file_format->getDataset()->findAndGetOFString(DCM_SOPInstanceUID, sop);
+			series_assembler->add(file_format, file_path.empty() ? std::string(sop.c_str()) : file_path);
+		},
+		[this]() {
+			{
+				std::lock_guard<std::mutex> lock(association_mutex);
+				++association_end_num;
+			}
+			association_cv.notify_all();
+		}));
+	receive_thread = std::thread([this]() {
+		OFCondition status = store_receiver->listen();
+		if (status.bad())
+			std::cerr << "C-STORE receiver stopped: " << status.text() << std::endl;
+	});
+	return true;
+}
+
+void DcmData::StopReceiver() {
+	if (!receive_thread.joinable())
 		return;
+	store_receiver->stop();
+	receive_thread.join();
+	store_receiver.reset();
+	association_cv.notify_all();
+}
+
+bool DcmData::StartWatch(std::string folder, int settle_ms,
+	const std::function<void(int series_idx, int slice_num)> &on_series_complete) {
+	if (folder_watcher || (load_thread.joinable() && !load_finished))
+		return false;
+	WaitForLoad();
+	BeginIngest(folder);
+
+	folder_watcher.reset(new DicomFolderWatcher());
+	bool started = folder_watcher->start(folder,
+		[this](const std::string &file_path) {
+			// A file still being copied fails to load and is offered again later
+			DcmFileFormat *file_format = new DcmFileFormat();
+			if (file_format->loadFile(file_path.c_str()).bad() || file_format->loadAllDataIntoMemory().bad()) {
+				delete file_format;
+				return false;
+			}
+			series_assembler->add(file_format, file_path);
+			return true;
+		},
+		[this, settle_ms, on_series_complete]() {
+			std::vector<std::string> complete_series = series_assembler->take_complete_series(settle_ms);
+			for (int i = 0; i < complete_series.size(); ++i) {
+				int series_slice_num = 0;
+				int series_idx = FindReceivedSeries(complete_series[i], series_slice_num);
+				if (on_series_complete && series_idx >= 0)
+					on_series_complete(series_idx, series_slice_num);
+			}
+		});
+	if (!started)
+		folder_watcher.reset();
+	return started;
+}
+
+void DcmData::StopWatch() {
+	if (!folder_watcher)
+		return;
+	folder_watcher->stop();
+	folder_watcher.reset();
+}
+
+int DcmData::ReceivedSliceCount() const {
+	return series_assembler ? series_assembler->slice_num() : 0;
+}
+
+bool DcmData::WaitForAssociation(int timeout_ms) {
+	std::unique_lock<std::mutex> lock(association_mutex);
+	auto association_ended = [this]() { return association_end_num > association_waited_num || !receive_thread.joinable(); };
+	if (timeout_ms < 0)
+		association_cv.wait(lock, association_ended);
+	else
+		association_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), association_ended);
+	if (association_end_num <= association_waited_num)
+		return false;
+	association_waited_num = association_end_num;
+	return true;
+}
+
+bool DcmData::LoadReceivedSeries(int series_idx) {
+	if (!series_assembler)
+		return false;
+	// Slices already in volume_buf from the last call are copied rather than decoded again,
+	// their decoded copies were dropped then. Keyed by SOP in volume order.
+	short *previous_buf = volume_buf;
+	volume_buf = nullptr;
+	std::map<std::string, int> previous_slices;
+	if (previous_buf != nullptr && (int)slice_sops.size() == slice_num) {
+		for (int s = 0; s < slice_num; ++s)
+			previous_slices[slice_sops[is_img_inverse ? s : (slice_num - s - 1)]] = s;
+	}
+	const int previous_num = slice_num;
+	const unsigned short previous_width = img_width, previous_height = img_height;
+	const float previous_slope = img_rescale_slope, previous_intercept = img_rescale_intercept;
+
+	DicomSeriesData *series = nullptr;
+	std::vector<int> selected_slices;
+	{
+		// Held across flush and select: add() registers and queues under this lock,
+		// so every selected slice is decoded and no worker still reads its dataset.
+		// Slices arriving meanwhile wait for the next call.
+		std::lock_guard<std::mutex> tree_lock(series_assembler->tree_mutex());
+		series_assembler->flush();
+		data_mgr->sort_slices();
+		if (!SelectSeries(series_idx)) {
+			delete[] previous_buf;
+			return false;
+		}
+		series = FindSeries(series_idx);
+		for (int i = 0; i < slice_num; ++i)
+			selected_slices.push_back(series->sorted_slice(i));
+	}
+
+	// A different geometry or rescale of the same SOPs is decoded from scratch
+	if (img_width != previous_width || img_height != previous_height ||
+		img_rescale_slope != previous_slope || img_rescale_intercept != previous_intercept)
+		previous_slices.clear();
+	const size_t slice_pixel_num = (size_t)img_width * img_height;
+	std::vector<int> previous_idx(slice_num, -1);
+	std::vector<int> new_slices;
+	bool unchanged = slice_num == previous_num;
+	for (int s = 0; s < slice_num; ++s) {
+		auto previous = previous_slices.find(slice_sops[is_img_inverse ? s : (slice_num - s - 1)]);
+		if (previous != previous_slices.end())
+			previous_idx[s] = previous->second;
+		else
+			new_slices.push_back(s);
+		unchanged = unchanged && previous_idx[s] == s;
+	}
+	if (unchanged) {
+		volume_buf = previous_buf;
+	}
+	else {
+		volume_buf = new short[slice_pixel_num * slice_num];
+		for (int s = 0; s < slice_num; ++s) {
+			if (previous_idx[s] >= 0)
+				std::copy(previous_buf + previous_idx[s] * slice_pixel_num,
+					previous_buf + (previous_idx[s] + 1) * slice_pixel_num, volume_buf + s * slice_pixel_num);
+		}
+		delete[] previous_buf;
+	}
+	for (int s = 0; s < slice_num; ++s) {
+		if (previous_idx[s] >= 0)
+			MarkSliceReady(s);
+	}
+	if (load_options.physical_read_order)
+		SortByPhysicalLayout(new_slices);
+	bool decoded = DecodeSlicesInOrder(volume_buf, slice_pixel_num, new_slices);
+
+	// The volume holds these slices now, drop their datasets and decoded copies
+	std::lock_guard<std::mutex> tree_lock(series_assembler->tree_mutex());
+	std::vector<DcmFileFormat *> released_formats;
+	for (int i = 0; i < slice_num; ++i) {
+		DcmFileFormat *&file_format = series->m_image_file_formats[selected_slices[i]];
+		if (file_format != nullptr)
+			released_formats.push_back(file_format);
+		file_format = nullptr;
+		slice_file_formats[i] = nullptr;
+	}
+	series_assembler->release(released_formats, slice_sops);
+	return decoded;
+}
+
+bool DcmData::RequestPreview(int series_idx, int max_size, int slice_count) {
+	std::vector<DicomPreviewSource> sources;
+	std::string key = PreviewSources(series_idx, max_size, slice_count, sources);
+	if (key.empty())
+		return false;
+	if (!preview_loader)
+		preview_loader.reset(new DicomPreviewLoader(0));
+	preview_loader->request(key, sources, max_size);
+	return true;
+}
+
+bool DcmData::GetPreview(int series_idx, DcmPreview &preview, int max_size, int slice_count, int timeout_ms) {
+	std::vector<DicomPreviewSource> sources;
+	std::string key = PreviewSources(series_idx, max_size, slice_count, sources);
+	if (key.empty())
+		return false;
+	DicomPreview cached;
+	if (!DicomPreviewCache::get_instance()->get(key, cached)) {
+		if (!preview_loader)
+			preview_loader.reset(new DicomPreviewLoader(0));
+		preview_loader->request(key, sources, max_size);
+		if (!preview_loader->wait(key, timeout_ms) || !DicomPreviewCache::get_instance()->get(key, cached))
+			return false;
 	}
-	int numberOfFiles = directory->GetNumberOfFiles();
-	for (int i = 0; i < numberOfFiles; i++) {
-		if (!directory->FileIsDirectory(directory->GetFile(i)))
-			file_names.push_back(directory->GetFile(i));
+	preview.width = cached.width;
+	preview.height = cached.height;
+	preview.sample_num = cached.sample_num;
+	preview.slice_num = cached.slice_num;
+	preview.pixels.swap(cached.pixels);
+	return true;
+}
+
+bool DcmData::LoadAsync(short *dst, size_t slice_stride) {
+	if (load_finished)
+		return true;
+	if (load_thread.joinable() || slice_files.empty())
+		return false;
+	if (dst == nullptr) {
+		if (volume_buf == nullptr)
+			volume_buf = new short[img_width * img_height * slice_num];
+		dst = volume_buf;
+		slice_stride = img_width * img_height;
+	}
+
+	// The centre slice is what the 2D views show first, then grow outwards
+	std::vector<int> volume_order;
+	volume_order.reserve(slice_num);
+	int centre = slice_num / 2;
+	volume_order.push_back(centre);
+	for (int d = 1; volume_order.size() < slice_num; ++d) {
+		if (centre + d < slice_num)
+			volume_order.push_back(centre + d);
+		if (centre - d >= 0)
+			volume_order.push_back(centre - d);
 	}
 
-	slice_num = file_names.size();
+	load_thread = std::thread(&DcmData::DecodeSlicesInOrder, this, dst, slice_stride, volume_order);
+	return true;
+}
+
+bool DcmData::LoadProgressive(DcmCoarseVolume &coarse, int slice_step, int pixel_step,
+	short *dst, size_t slice_stride) {
+	if (load_finished || load_thread.joinable() || slice_files.empty())
+		return false;
+	slice_step = std::max(slice_step, 1);
+	pixel_step = std::max(pixel_step, 1);
+	if (dst == nullptr) {
+		if (volume_buf == nullptr)
+			volume_buf = new short[img_width * img_height * slice_num];
+		dst = volume_buf;
+		slice_stride = img_width * img_height;
+	}
+
+	// The coarse slices are final slices of the volume, marked ready as they land
+	std::vector<int> coarse_order;
+	for (int i = 0; i < slice_num; i += slice_step)
+		coarse_order.push_back(i);
+	DecodeSliceList(dst, slice_stride, coarse_order, 0, true);
+
+	coarse.width = (img_width + pixel_step - 1) / pixel_step;
+	coarse.height = (img_height + pixel_step - 1) / pixel_step;
+	coarse.slice_num = (int)coarse_order.size();
+	coarse.pixel_spacing[0] = img_pixel_spacing[0] * pixel_step;
+	coarse.pixel_spacing[1] = img_pixel_spacing[1] * pixel_step;
+	coarse.slice_spacing = img_slice_thickness * slice_step;
+	coarse.values.resize((size_t)coarse.width * coarse.height * coarse.slice_num);
+	int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
+#pragma omp parallel for num_threads(thread_num)
+	for (int k = 0; k < coarse.slice_num; ++k) {
+		const short *slice_buf = dst + coarse_order[k] * slice_stride;
+		short *coarse_buf = coarse.values.data() + (size_t)k * coarse.width * coarse.height;
+		for (int y = 0; y < coarse.height; ++y) {
+			int y1 = std::min((y + 1) * pixel_step, (int)img_height);
+			for (int x = 0; x < coarse.width; ++x) {
+				int x1 = std::min((x + 1) * pixel_step, (int)img_width);
+				int sum = 0;
+				for (int sy = y * pixel_step; sy < y1; ++sy)
+					for (int sx = x * pixel_step; sx < x1; ++sx)
+						sum += slice_buf[sy * img_width + sx];
+				coarse_buf[y * coarse.width + x] = (short)(sum / ((y1 - y * pixel_step) * (x1 - x * pixel_step)));
+			}
+		}
+	}
 
-	DicomHeaderParser header_parser;
-	for (int i = 0; i < file_names.size(); ++i) {
-		header_parser.parse_header_info(folder_path + "\\" + file_names[i]);
+	// The rest from the centre outwards, as LoadAsync
+	std::vector<int> volume_order;
+	volume_order.reserve(slice_num - coarse_order.size());
+	int centre = slice_num / 2;
+	for (int d = 0; centre + d < slice_num || centre - d >= 0; ++d) {
+		if (centre + d < slice_num && (centre + d) % slice_step != 0)
+			volume_order.push_back(centre + d);
+		if (d > 0 && centre - d >= 0 && (centre - d) % slice_step != 0)
+			volume_order.push_back(centre - d);
 	}
 
-	DicomDataMgr *data_mgr = DicomDataMgr::get_instance();
+	load_thread = std::thread(&DcmData::DecodeSlicesInOrder, this, dst, slice_stride, volume_order);
+	return true;
+}
+
+bool DcmData::IsSliceReady(int slice_idx) const {
+	if (!slice_ready_bits || slice_idx < 0 || slice_idx >= slice_num)
+		return false;
+	uint64_t word = slice_ready_bits[slice_idx >> 6].load(std::memory_order_acquire);
+	return (word >> (slice_idx & 63)) & 1;
+}
+
+int DcmData::ReadySliceCount() const {
+	return slice_ready_num.load(std::memory_order_acquire);
+}
+
+bool DcmData::WaitForSlices(int first, int last, int timeout_ms) {
+	first = std::max(first, 0);
+	last = std::min(last, slice_num - 1);
+	if (first > last)
+		return false;
 
-	instance_number_to_idx_map = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_instance_number_to_idx_map;
+	std::unique_lock<std::mutex> lock(slice_ready_mutex);
+	auto done = [&]() { return load_finished || SliceRangeReady(first, last); };
+	// Nothing running could ever mark the range, waiting would never end
+	bool loading = load_thread.joinable() || receive_thread.joinable() || folder_watcher;
+	if (!loading && !done())
+		return false;
+	if (timeout_ms < 0)
+		slice_ready_cv.wait(lock, done);
+	else
+		slice_ready_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+	return SliceRangeReady(first, last);
+}
+
+void DcmData::WaitForLoad() {
+	if (load_thread.joinable())
+		load_thread.join();
+}
+
+bool DcmData::DecodeSlicesInOrder(short *dst, size_t slice_stride, std::vector<int> volume_order) {
+	if (dst == nullptr || slice_files.empty())
+		return false;
+
+	int failed_num = DecodeSliceList(dst, slice_stride, volume_order, 0, true);
+
+	// Parsed files were decoded in place and cannot serve a second pass
+	ReleaseParsedFiles();
+	{
+		std::lock_guard<std::mutex> lock(slice_ready_mutex);
+		load_finished = true;
+	}
+	slice_ready_cv.notify_all();
+	return failed_num == 0;
+}
 
-	is_img_inverse = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_locations[0] < data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_locations[1];
-	img_pixel_spacing[0] = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_pixel_spacing[0];
-	img_pixel_spacing[1] = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_pixel_spacing[1];
-	data_mgr->m_patients[0]->m_studies[0]->m_series[0]->update_slice_thickness();
-	img_slice_thickness = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_series_slice_thickness;
-	img_width = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_resolution[0];
-	img_height = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_resolution[1];
-	img_bit_num = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_bits_allocated;
-	img_sample_num = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_samples_per_pixel;
-	img_modality = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_series_modality;
-	img_rescale_slope = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_rescale_slope;
-	img_rescale_intercept = data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_rescale_intercept;
-	img_planar_configuration = atoi(data_mgr->m_patients[0]->m_studies[0]->m_series[0]->m_planar_configuration.c_str());
+int DcmData::DecodeSliceList(short *dst, size_t slice_stride, const std::vector<int> &volume_order,
+	int dst_first_slice, bool mark_ready) {
+	const int slice_pixel_num = img_width * img_height;
+	int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
+	int failed_num = 0;
+
+	// The readahead thread walks the files in the order the loop hands them out
+	std::unique_ptr<DicomIoScheduler> io_scheduler;
+	if (load_options.readahead_window > 0) {
+		std::vector<std::string> read_files(volume_order.size());
+		for (int n = 0; n < (int)volume_order.size(); ++n)
+			read_files[n] = slice_files[is_img_inverse ? volume_order[n] : (slice_num - volume_order[n] - 1)];
+		io_scheduler.reset(new DicomIoScheduler(read_files, load_options.readahead_window));
+	}
+
+#pragma omp parallel num_threads(thread_num) reduction(+:failed_num)
+	{
+		DicomDataParser data_parser;
+		data_parser.prepare_series(img_bit_num, img_sample_num, img_modality,
+			img_rescale_slope, img_rescale_intercept, img_planar_configuration);
+		// Color slices decode 3 samples per pixel, only the first plane goes to the volume
+		std::vector<short> sample_buf(img_sample_num == "1" ? 0 : slice_pixel_num * 3);
+		DicomSliceCache *slice_cache = load_options.bypass_slice_cache ? nullptr : DicomSliceCache::get_instance();
+		size_t slice_value_num = sample_buf.empty() ? slice_pixel_num : sample_buf.size();
+
+#pragma omp for schedule(dynamic)
+		for (int n = 0; n < (int)volume_order.size(); ++n) {
+			if (load_cancelled)
+				continue;
+			int slice_idx = volume_order[n];
+			int i = is_img_inverse ? slice_idx : (slice_num - slice_idx - 1);
+			short *slice_buf = dst + (slice_idx - dst_first_slice) * slice_stride;
+			short *img_buf = sample_buf.empty() ? slice_buf : sample_buf.data();
+			// A slice decoded on arrival or by an earlier load skips the file altogether
+			bool cached = (series_assembler && series_assembler->get(slice_sops[i], img_rescale_slope, img_rescale_intercept, img_buf, slice_value_num)) ||
+				(slice_cache && slice_cache->get(slice_sops[i], img_rescale_slope, img_rescale_intercept, img_buf, slice_value_num));
+			// A file already parsed for the header pass has its pixels in memory
+			bool decoded = cached || (load_options.mapped_pixel_read && slice_file_formats[i] == nullptr &&
+				data_parser.get_data_slice_mapped(slice_files[i], img_buf, img_width, img_height, img_bit_num,
+					img_sample_num, img_modality, img_rescale_slope, img_rescale_intercept, img_planar_configuration));
+			if (!decoded)
+				decoded = data_parser.get_data_slice(slice_files[i], img_buf, img_width, img_height, img_bit_num,
+					img_sample_num, img_modality, img_rescale_slope, img_rescale_intercept, img_planar_configuration, slice_file_formats[i]);
+			if (decoded && !cached && slice_cache)
+				slice_cache->put(slice_sops[i], img_rescale_slope, img_rescale_intercept, img_buf, slice_value_num);
+
+			if (!decoded) {
+				std::fill(slice_buf, slice_buf + slice_pixel_num, 0);
+				++failed_num;
+			}
+			else if (img_buf != slice_buf)
+				std::copy(img_buf, img_buf + slice_pixel_num, slice_buf);
+			if (mark_ready)
+				MarkSliceReady(slice_idx);
+			if (io_scheduler)
+				io_scheduler->advance();
+		}
+	}
+	return failed_num;
+}
+
+void DcmData::ResetSliceReady() {
+	int word_num = std::max((slice_num + 63) / 64, 1);
+	slice_ready_bits.reset(new std::atomic<uint64_t>[word_num]);
+	for (int i = 0; i < word_num; ++i)
+		slice_ready_bits[i].store(0, std::memory_order_relaxed);
+	slice_ready_num = 0;
+	load_finished = false;
+}
+
+void DcmData::MarkSliceReady(int slice_idx) {
+	slice_ready_bits[slice_idx >> 6].fetch_or(uint64_t(1) << (slice_idx & 63), std::memory_order_release);
+	slice_ready_num.fetch_add(1, std::memory_order_release);
+	// Waiters check the bits under the mutex, taking it here rules out a lost wakeup
+	{
+		std::lock_guard<std::mutex> lock(slice_ready_mutex);
+	}
+	slice_ready_cv.notify_all();
+}
+
+void DcmData::MarkAllSlicesReady() {
+	for (int i = 0; i < (slice_num + 63) / 64; ++i)
+		slice_ready_bits[i].store(~uint64_t(0), std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(slice_ready_mutex);
+		slice_ready_num = slice_num;
+		load_finished = true;
+	}
+	slice_ready_cv.notify_all();
+}
+
+bool DcmData::SliceRangeReady(int first, int last) const {
+	for (int i = first; i <= last; ++i)
+		if (!IsSliceReady(i))
+			return false;
+	return true;
+}
+
+DicomSeriesData *DcmData::FindSeries(int series_idx) const {
+	if (series_idx < 0)
+		return nullptr;
+	for (DicomPatientData *patient : data_mgr->m_patients) {
+		for (DicomStudyData *study : patient->m_studies) {
+			if (series_idx < (int)study->m_series.size())
+				return study->m_series[series_idx];
+			series_idx -= (int)study->m_series.size();
+		}
+	}
+	return nullptr;
+}
+
+int DcmData::FindReceivedSeries(const std::string &series_instance_UID, int &series_slice_num) const {
+	// Index in GetSeriesList order, read under the tree lock while slices keep arriving
+	std::lock_guard<std::mutex> tree_lock(series_assembler->tree_mutex());
+	int series_idx = 0;
+	series_slice_num = 0;
+	for (DicomPatientData *patient : data_mgr->m_patients) {
+		for (DicomStudyData *study : patient->m_studies) {
+			for (DicomSeriesData *series : study->m_series) {
+				if (series->m_series_instance_ID == series_instance_UID) {
+					series_slice_num = (int)series->m_image_files.size();
+					return series_idx;
+				}
+				++series_idx;
+			}
+		}
+	}
+	return -1;
+}
 
+void DcmData::BeginIngest(std::string ingest_folder) {
+	// Receiver and watcher feed one tree, only the first of them replaces the scan
+	if (series_assembler && (receive_thread.joinable() || folder_watcher))
+		return;
+	ReleaseParsedFiles();
 	data_mgr->clear_data();
+	folder_path = ingest_folder;
+	file_names.clear();
+	slice_num = 0;
+	int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
+	series_assembler.reset(new DicomSeriesAssembler(data_mgr, thread_num));
+}
 
-	DicomDataParser data_parser;
+std::string DcmData::PreviewSources(int series_idx, int max_size, int slice_count,
+	std::vector<DicomPreviewSource> &sources) {
+	sources.clear();
+	slice_count = std::max(slice_count, 1);
+	std::vector<std::string> files;
+	std::string series_key;
+	{
+		// Received trees keep growing, read them under the tree lock
+		std::unique_lock<std::mutex> tree_lock;
+		if (series_assembler)
+			tree_lock = std::unique_lock<std::mutex>(series_assembler->tree_mutex());
+		DicomSeriesData *series = FindSeries(series_idx);
+		if (series == nullptr || series->m_image_files.empty())
+			return std::string();
+		series->sort_slices();
+		int series_slice_num = series->slice_num();
+		int source_num = std::min(slice_count, series_slice_num);
+		// Evenly spaced in instance order, a single slice is the middle one
+		for (int i = 0; i < source_num; ++i)
+			files.push_back(series->m_image_files[series->sorted_slice((int)((i + 0.5) * series_slice_num / source_num))]);
+		// Series Instance UID names a series across scans and folders
+		series_key = series->m_series_instance_ID.empty() ? series->m_image_files[series->sorted_slice(0)] : series->m_series_instance_ID;
+		// A received series is a new preview once it grows
+		if (series_assembler)
+			series_key += "|" + std::to_string(series_slice_num);
+	}
 
-	volume_buf = new short[img_width * img_height * slice_num];
+	DicomPreviewSource source;
+	source.frame_idx = 0;
+	if (files.size() == 1 && slice_count > 1) {
+		// A one file series is previewed from its frames
+		DcmFileFormat fileformat;
+		Sint32 frame_count = 1;
+		if (fileformat.loadFileUntilTag(files[0].c_str(), EXS_Unknown, EGL_noChange, DCM_MaxReadLength,
+			ERM_autoDetect, DCM_PixelData).good())
+			fileformat.getDataset()->findAndGetSint32(DCM_NumberOfFrames, frame_count);
+		int source_num = std::min(slice_count, std::max((int)frame_count, 1));
+		source.file_path = files[0];
+		for (int i = 0; i < source_num; ++i) {
+			source.frame_idx = (int)((i + 0.5) * frame_count / source_num);
+			sources.push_back(source);
+		}
+	} else {
+		for (int i = 0; i < files.size(); ++i) {
+			source.file_path = files[i];
+			sources.push_back(source);
+		}
+	}
+	return DicomPreviewCache::make_key(series_key, max_size, slice_count);
+}
 
-	for (int i = 0; i < slice_num; ++i) {
-		short *img_buf = new short[img_width * img_height];
-		data_parser.get_data_slice(folder_path + "\\" + file_names[instance_number_to_idx_map[i]], img_buf, img_width, img_height, img_bit_num,
-			img_sample_num, img_modality, img_rescale_slope, img_rescale_intercept, img_planar_configuration);
+void DcmData::ReleaseParsedFiles() {
+	for (int i = 0; i < parsed_files.size(); ++i)
+		delete parsed_files[i];
+	parsed_files.clear();
+	std::fill(slice_file_formats.begin(), slice_file_formats.end(), nullptr);
+}
 
-		for (int j = 0; j < img_width * img_height; ++j) {
-			volume_buf[(is_img_inverse ? i : (slice_num - i - 1)) * img_width * img_height + j] = img_buf[j];
+void DcmData::SortByPhysicalLayout(std::vector<int> &volume_order) {
+	{
+		// Concurrent slab decodes share the keys, the first caller fills them and the others wait
+		std::lock_guard<std::mutex> lock(slice_layout_mutex);
+		if (slice_layout_keys.size() != slice_files.size()) {
+			// one open per file, run in parallel to hide NFS round trips
+			std::vector<unsigned long long> layout_keys(slice_files.size(), 0);
+			const int file_num = slice_files.size();
+			int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
+#pragma omp parallel for num_threads(thread_num) schedule(dynamic)
+			for (int i = 0; i < file_num; ++i)
+				layout_keys[i] = DicomIoScheduler::physical_key(slice_files[i]);
+			slice_layout_keys.swap(layout_keys);
 		}
+	}
+	std::stable_sort(volume_order.begin(), volume_order.end(), [this](int a, int b) {
+		int file_a = is_img_inverse ? a : (slice_num - a - 1);
+		int file_b = is_img_inverse ? b : (slice_num - b - 1);
+		return slice_layout_keys[file_a] < slice_layout_keys[file_b];
+	});
+}
 
-		delete[] img_buf;
+void DcmData::ParseHeaders(const std::function<bool(DicomCrawlEntry &)> &next_file,
+	std::vector<std::string> &file_paths) {
+	// Parsed files are kept while they fit the budget, the rest are read again when decoding
+	size_t parsed_bytes = 0;
+	int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
+
+#pragma omp parallel num_threads(thread_num)
+	{
+		DicomHeaderParser header_parser(data_mgr);
+		header_parser.set_header_only(load_options.header_only_scan);
+		if (load_options.geometry_only_header)
+			header_parser.set_profile(DicomHeaderParser::PROFILE_GEOMETRY);
+
+		// Every thread pulls files until the listing runs dry
+		DicomCrawlEntry entry;
+		while (next_file(entry)) {
+			unsigned long long file_size = entry.file_size;
+			bool keep_parsed = false;
+			if (load_options.reuse_parsed_files && file_size == ~0ULL) {
+				struct stat file_stat;
+				if (stat(entry.file_path.c_str(), &file_stat) == 0)
+					file_size = file_stat.st_size;
+			}
+			if (load_options.reuse_parsed_files && file_size != ~0ULL) {
+#pragma omp critical(parsed_bytes_budget)
+				{
+					if (parsed_bytes + file_size <= load_options.reuse_parsed_files_max_bytes) {
+						parsed_bytes += file_size;
+						keep_parsed = true;
+					}
+				}
+			}
+			DcmFileFormat *file_format = nullptr;
+			if (keep_parsed) {
+				file_format = new DcmFileFormat();
+				if (!file_format->loadFile(entry.file_path.c_str()).good() || !file_format->loadAllDataIntoMemory().good()) {
+					delete file_format;
+					file_format = nullptr;
+#pragma omp critical(parsed_bytes_budget)
+					parsed_bytes -= file_size;
+				}
+			}
+#pragma omp critical(parsed_file_list)
+			{
+				file_paths.push_back(entry.file_path);
+				if (file_format)
+					parsed_files.push_back(file_format);
+			}
+			header_parser.parse_header_info(entry.file_path, file_format);
+		}
 	}
 }
 
@@ -121,26 +1110,160 @@ void DcmData::LoadMultiFrameData(std::string file_path) {
 	DcmDataset *dataset = fileformat.getDataset();
 	E_TransferSyntax xfer = dataset->getOriginalXfer();
 
-	OFString patientname;
-	dataset->findAndGetOFString(DCM_PatientName, patientname);
+	int stored_bits = 0;
+	bool is_signed = false;
+	bool is_inverted = false;
+	if (!ReadMultiFrameHeader(dataset, stored_bits, is_signed, is_inverted))
+		return;
+	const unsigned short bits_allocated = img_bit_num;
+	const unsigned short samples_per_pixel = img_sample_num == "3" ? 3 : 1;
+	const unsigned short planar_configuration = img_planar_configuration;
 
-	unsigned short bit_count(0);
-	dataset->findAndGetUint16(DCM_BitsStored, bit_count);
+	const size_t slice_pixel_num = (size_t)img_width * img_height;
+	const int sample_num = samples_per_pixel;
+	const size_t frame_bytes = slice_pixel_num * sample_num * (bits_allocated / 8);
+	int thread_num = load_options.thread_num > 0 ? load_options.thread_num : omp_get_max_threads();
 
-	OFString isRGB;
-	dataset->findAndGetOFString(DCM_PhotometricInterpretation, isRGB);
+	volume_buf = new short[slice_pixel_num * slice_num];
+	ResetSliceReady();
 
-	unsigned short img_bits(0);
-	dataset->findAndGetUint16(DCM_SamplesPerPixel, img_bits);
-	int Img_bitCount = (int)img_bits;
+	if (!DcmXfer(xfer).isEncapsulated()) {
+		// Native frames lie back to back in PixelData, split them across threads
+		const unsigned char *pixel_buf = nullptr;
+		unsigned long pixel_count = 0;
+		if (bits_allocated == 8) {
+			dataset->findAndGetUint8Array(DCM_PixelData, pixel_buf, &pixel_count);
+		} else {
+			const Uint16 *pixel_buf16 = nullptr;
+			dataset->findAndGetUint16Array(DCM_PixelData, pixel_buf16, &pixel_count);
+			pixel_buf = (const unsigned char *)pixel_buf16;
+			pixel_count *= 2;
+		}
+		int decoded_num = pixel_buf != nullptr ? (int)std::min<size_t>(pixel_count / frame_bytes, slice_num) : 0;
+		if (decoded_num < slice_num)
+			std::cerr << "Multi frame pixel data holds " << decoded_num << " of " << slice_num << " frames" << std::endl;
 
-	OFString framecount;
-	dataset->findAndGetOFString(DCM_NumberOfFrames, framecount);
+#pragma omp parallel for num_threads(thread_num) schedule(static)
+		for (int k = 0; k < slice_num; ++k) {
+			short *frame_buf = volume_buf + k * slice_pixel_num;
+			if (k < decoded_num)
+				ConvertFrame(pixel_buf + k * frame_bytes, frame_buf, slice_pixel_num,
+					bits_allocated, stored_bits, is_signed, is_inverted, sample_num, planar_configuration);
+			else
+				std::fill(frame_buf, frame_buf + slice_pixel_num, 0);
+		}
+		MarkAllSlicesReady();
+		return;
+	}
 
-	unsigned short m_width;
-	unsigned short m_height;
-	dataset->findAndGetUint16(DCM_Rows, m_height);
-	dataset->findAndGetUint16(DCM_Columns, m_width);
+	if (DicomJ2kDecoder::is_j2k(xfer)) {
+		// The fragments of every frame are located once, the frames then decode
+		// independently, each thread running its own OpenJPEG codec
+		DicomJ2kDecoder j2k_decoder;
+		bool j2k_opened = j2k_decoder.open(dataset, slice_num);
+		int failed_num = 0;
+#pragma omp parallel num_threads(thread_num) reduction(+:failed_num)
+		{
+			std::vector<unsigned char> frame_buf(frame_bytes);
+#pragma omp for schedule(dynamic)
+			for (int k = 0; k < slice_num; ++k) {
+				short *dst = volume_buf + k * slice_pixel_num;
+				if (j2k_opened && j2k_decoder.decode_frame(k, frame_buf.data(), frame_bytes,
+					bits_allocated, sample_num, planar_configuration)) {
+					ConvertFrame(frame_buf.data(), dst, slice_pixel_num,
+						bits_allocated, stored_bits, is_signed, is_inverted, sample_num, planar_configuration);
+				} else {
+					std::fill(dst, dst + slice_pixel_num, 0);
+					++failed_num;
+				}
+			}
+		}
+		if (failed_num > 0)
+			std::cerr << "Failed to decode " << failed_num << " of " << slice_num << " frames | " << file_path << std::endl;
+		MarkAllSlicesReady();
+		return;
+	}
+
+	// Encapsulated frames decode fragment by fragment, every thread opens its own
+	// copy so the codecs never share a dataset. Fragments are read on demand, a
+	// static schedule keeps each thread on consecutive frames to carry the
+	// fragment position forward.
+	DicomCodecRegistry::register_codecs();
+	int failed_num = 0;
+#pragma omp parallel num_threads(thread_num) reduction(+:failed_num)
+	{
+		DcmFileFormat thread_fileformat;
+		DcmDataset *thread_dataset = nullptr;
+		DcmPixelData *pixel_data = nullptr;
+		DcmElement *pixel_element = nullptr;
+		if (thread_fileformat.loadFile(file_path.c_str()).good()) {
+			thread_dataset = thread_fileformat.getDataset();
+			if (thread_dataset->findAndGetElement(DCM_PixelData, pixel_element).good() && pixel_element != nullptr)
+				pixel_data = OFstatic_cast(DcmPixelData *, pixel_element);
+		}
+		std::vector<unsigned char> frame_buf(frame_bytes + 1);
+		DcmFileCache file_cache;
+		Uint32 start_fragment = 0;
+		int next_frame = -1;
+
+#pragma omp for schedule(static)
+		for (int k = 0; k < slice_num; ++k) {
+			// the fragment hint is only valid for the frame right after the last one
+			if (k != next_frame)
+				start_fragment = 0;
+			next_frame = k + 1;
+
+			OFString color_model;
+			bool decoded = pixel_data != nullptr && pixel_data->getUncompressedFrame(thread_dataset, k, start_fragment,
+				frame_buf.data(), (Uint32)frame_buf.size(), color_model, &file_cache).good();
+			short *dst = volume_buf + k * slice_pixel_num;
+			if (decoded) {
+				// codecs may store color frames in a different planar configuration
+				unsigned short frame_planar(planar_configuration);
+				thread_dataset->findAndGetUint16(DCM_PlanarConfiguration, frame_planar);
+				ConvertFrame(frame_buf.data(), dst, slice_pixel_num,
+					bits_allocated, stored_bits, is_signed, is_inverted, sample_num, frame_planar);
+			} else {
+				std::fill(dst, dst + slice_pixel_num, 0);
+				start_fragment = 0;
+				++failed_num;
+			}
+		}
+	}
+	if (failed_num > 0)
+		std::cerr << "Failed to decode " << failed_num << " of " << slice_num << " frames | " << file_path << std::endl;
+	MarkAllSlicesReady();
+}
+
+bool DcmData::ReadMultiFrameHeader(DcmDataset *dataset, int &stored_bits, bool &is_signed, bool &is_inverted) {
+	unsigned short bits_allocated(0), bits_stored(0), pixel_representation(0);
+	dataset->findAndGetUint16(DCM_BitsAllocated, bits_allocated);
+	dataset->findAndGetUint16(DCM_BitsStored, bits_stored);
+	dataset->findAndGetUint16(DCM_PixelRepresentation, pixel_representation);
+
+	unsigned short samples_per_pixel(1), planar_configuration(0);
+	dataset->findAndGetUint16(DCM_SamplesPerPixel, samples_per_pixel);
+	dataset->findAndGetUint16(DCM_PlanarConfiguration, planar_configuration);
+
+	Sint32 frame_count(1);
+	dataset->findAndGetSint32(DCM_NumberOfFrames, frame_count);
+
+	unsigned short rows(0), columns(0);
+	dataset->findAndGetUint16(DCM_Rows, rows);
+	dataset->findAndGetUint16(DCM_Columns, columns);
+
+	OFString modality_str, photometric_str;
+	dataset->findAndGetOFString(DCM_Modality, modality_str);
+	dataset->findAndGetOFString(DCM_PhotometricInterpretation, photometric_str);
+
+	// Enhanced objects carry the rescale in the functional groups, one value for all frames is assumed
+	OFString slope_str, intercept_str;
+	dataset->findAndGetOFString(DCM_RescaleSlope, slope_str, 0, OFTrue);
+	dataset->findAndGetOFString(DCM_RescaleIntercept, intercept_str, 0, OFTrue);
+	img_rescale_slope = slope_str.empty() ? 1.0f : ofstr_to_float(slope_str);
+	img_rescale_intercept = intercept_str.empty() ? 0.0f : ofstr_to_float(intercept_str);
+	if (img_rescale_slope == 0.0f)
+		img_rescale_slope = 1.0f;
 
 	OFString dis_detector_str, dis_patient_str;
 	dataset->findAndGetOFString(DCM_DistanceSourceToDetector, dis_detector_str);
@@ -156,53 +1279,51 @@ void DcmData::LoadMultiFrameData(std::string file_path) {
 	img_pixel_spacing[0] = l_spacing[0];
 	img_pixel_spacing[1] = l_spacing[1];
 
-	const char* transferSyntax = NULL;
-	fileformat.getMetaInfo()->findAndGetString(DCM_TransferSyntaxUID, transferSyntax);
-	std::string losslessTransUID = "1.2.840.10008.1.2.4.70";
-	std::string lossTransUID = "1.2.840.10008.1.2.4.51";
-	std::string losslessP14 = "1.2.840.10008.1.2.4.57";
-	std::string lossyP1 = "1.2.840.10008.1.2.4.50";
-	std::string lossyRLE = "1.2.840.10008.1.2.5";
-	if (transferSyntax == losslessTransUID || transferSyntax == lossTransUID ||
-		transferSyntax == losslessP14 || transferSyntax == lossyP1) {
-		DJDecoderRegistration::registerCodecs();
-		dataset->chooseRepresentation(EXS_LittleEndianExplicit, NULL);
-		DJDecoderRegistration::cleanup();
-	}
-	else if (transferSyntax == lossyRLE) {
-		DcmRLEDecoderRegistration::registerCodecs();
-		dataset->chooseRepresentation(EXS_LittleEndianExplicit, NULL);
-		DcmRLEDecoderRegistration::cleanup();
-	}
-	else {
-		dataset->chooseRepresentation(xfer, NULL);
+	if ((bits_allocated != 8 && bits_allocated != 16) || (samples_per_pixel != 1 && samples_per_pixel != 3)) {
+		std::cerr << "Unsupported multi frame pixel format: " << bits_allocated << " bits, "
+			<< samples_per_pixel << " samples" << std::endl;
+		return false;
 	}
 
-	DicomImage* m_dcmImage = new DicomImage((DcmObject*)dataset, xfer);
-
-	slice_num = m_dcmImage->getFrameCount();
-	img_width = m_dcmImage->getHeight();
-	img_height = m_dcmImage->getWidth();
-
-	volume_buf = new short[img_width * img_height * slice_num];
+	slice_num = frame_count > 0 ? frame_count : 1;
+	img_width = columns;
+	img_height = rows;
+	img_bit_num = bits_allocated;
+	img_sample_num = samples_per_pixel == 3 ? "3" : "1";
+	img_modality = modality_str.c_str();
+	img_planar_configuration = planar_configuration;
+	stored_bits = bits_stored > 0 && bits_stored <= bits_allocated ? bits_stored : bits_allocated;
+	is_signed = pixel_representation == 1;
+	is_inverted = samples_per_pixel == 1 && photometric_str == "MONOCHROME1";
+	return true;
+}
 
-	for (int k = 0; k < this->slice_num; k++) {
-		unsigned char *pixelData = (unsigned char*)(m_dcmImage->getOutputData(8, k, 0));
-		if (pixelData != NULL) {
-			if (3 == Img_bitCount) {
-				for (int i = 0; i < m_height; i++) {
-					for (int j = 0; j < m_width; j++) {
-						volume_buf[k * img_width * img_height + i * img_width + j] = *(pixelData + i * m_width * 3 + j * 3);
-					}
-				}
-			} else if (1 == Img_bitCount) {
-				uchar* data = nullptr;
-				for (int i = 0; i < m_height; i++) {
-					for (int j = 0; j < m_width; j++) {
-						volume_buf[k * img_width * img_height + i * img_width + j] = *(pixelData + i * m_width + j);
-					}
-				}
-			}
+void DcmData::ConvertFrame(const unsigned char *frame, short *dst, size_t pixel_num, int bits_allocated,
+	int bits_stored, bool is_signed, bool is_inverted, int sample_num, int planar_configuration) {
+	// Color frames keep their first sample, as volume slices do
+	const size_t sample_step = (sample_num == 3 && planar_configuration == 0) ? 3 : 1;
+	// MONOCHROME1 is flipped within the stored range so bright stays dense, then rescaled like single frames
+	const bool rescaled = img_rescale_slope != 1.0f || img_rescale_intercept != 0.0f;
+	if (bits_allocated == 8) {
+		for (size_t i = 0; i < pixel_num; ++i) {
+			int value = frame[i * sample_step];
+			if (is_inverted)
+				value = 255 - value;
+			dst[i] = rescaled ? clamp_to_short(value * img_rescale_slope + img_rescale_intercept) : (short)value;
 		}
+		return;
+	}
+
+	// Bits above BitsStored may hold overlays, signed values extend from the stored sign bit
+	const Uint16 *frame16 = (const Uint16 *)frame;
+	const int value_mask = (1 << bits_stored) - 1;
+	const int sign_bit = 1 << (bits_stored - 1);
+	for (size_t i = 0; i < pixel_num; ++i) {
+		int value = frame16[i * sample_step] & value_mask;
+		if (is_signed && (value & sign_bit))
+			value -= value_mask + 1;
+		if (is_inverted)
+			value = is_signed ? -1 - value : value_mask - value;
+		dst[i] = rescaled ? clamp_to_short(value * img_rescale_slope + img_rescale_intercept) : clamp_to_short(value);
 	}
 }
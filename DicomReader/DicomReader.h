@@ -9,16 +9,239 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+class DcmFileFormat;
+class DcmDataset;
+class DicomDataMgr;
+class DicomSeriesData;
+struct DicomCrawlEntry;
+class DicomSeriesAssembler;
+class DicomStoreReceiver;
+class DicomFolderWatcher;
+class DicomPreviewLoader;
+class DicomFrameStream;
+struct DicomPreviewSource;
+
+// Options controlling how a series is loaded
+struct DcmLoadOptions {
+	DcmLoadOptions() : thread_num(1), reuse_parsed_files(false),
+		reuse_parsed_files_max_bytes(1024 * 1024 * 1024), header_only_scan(false),
+		mapped_pixel_read(false), decode_pixels(true), series_index(0), geometry_only_header(false),
+		physical_read_order(false), readahead_window(0), recursive_scan(false),
+		use_dicomdir(true), frame_window(0), bypass_slice_cache(false) {}
+
+	// Number of threads decoding slices, 1 = serial, 0 = one per core
+	int thread_num;
+	// Keep the files parsed for the header pass and decode pixels from them
+	bool reuse_parsed_files;
+	// Memory cap for kept files, files beyond it are read again for decoding
+	size_t reuse_parsed_files_max_bytes;
+	// Header pass stops at PixelData, GetHeaderScanStats reports its throughput
+	bool header_only_scan;
+	// Directory of the persistent folder index, empty disables it
+	std::string index_cache_dir;
+	// Read uncompressed little endian pixels straight from a file mapping,
+	// other transfer syntaxes still decode through dcmtk
+	bool mapped_pixel_read;
+	// Decode into volume_buf while loading, when off only the header pass
+	// runs and the caller decodes into its own storage with DecodeSlices
+	bool decode_pixels;
+	// Series loaded by the constructor, an index into GetSeriesList
+	int series_index;
+	// Header pass keeps only the tags needed to assemble the volume, patient,
+	// study and series descriptions are read later by LoadSeriesDetails
+	bool geometry_only_header;
+	// Full and slab decodes read files in on-disk order (first extent, else
+	// file index/inode) rather than instance order, slices still land in place
+	bool physical_read_order;
+	// Files kept in the OS cache ahead of the decoders, 0 disables readahead
+	int readahead_window;
+	// ScanFolder also walks subfolders, e.g. patient/study/series trees
+	bool recursive_scan;
+	// A DICOMDIR in the scanned folder supplies the tree, images are only
+	// opened for the tags its records do not carry
+	bool use_dicomdir;
+	// Multi frame files are streamed rather than loaded: frames decode on
+	// demand through ReadFrame, at most frame_window at a time. 0 loads them all.
+	int frame_window;
+	// Slices neither come from nor go to the process wide decoded slice cache,
+	// the cache itself and its budget are left alone
+	bool bypass_slice_cache;
+};
+
+// One series found by ScanFolder
+struct DcmSeriesInfo {
+	std::string patient_ID;
+	std::string study_ID;
+	std::string series_number;
+	std::string series_description;
+	std::string modality;
+	int slice_num;
+	unsigned short width;
+	unsigned short height;
+};
+
+// Counters of the process wide decoded slice cache
+struct DcmSliceCacheStats {
+	unsigned long long hit_num;
+	unsigned long long miss_num;
+	unsigned long long eviction_num;
+	size_t entry_num;
+	size_t used_bytes;
+	size_t max_bytes;
+};
+
+// Timing of the last ScanFolder, whichever way the tree was built
+struct DcmHeaderScanStats {
+	int file_num;
+	double seconds;
+	double files_per_second;
+};
+
+// Best pass of BenchmarkDecode
+struct DcmDecodeBenchmark {
+	std::string transfer_syntax;
+	int frame_num;
+	double seconds;
+	double frames_per_second;
+	// decoded output, 2 bytes per voxel
+	double mb_per_second;
+};
+
+// Subsampled volume decoded first by a progressive load
+struct DcmCoarseVolume {
+	unsigned short width;
+	unsigned short height;
+	int slice_num;
+	float pixel_spacing[2];
+	float slice_spacing;
+	std::vector<short> values;
+};
+
+// Reduced slices of one series for browsing, windowed to 8 bit
+struct DcmPreview {
+	unsigned short width;
+	unsigned short height;
+	// 1 grey, 3 RGB interleaved
+	int sample_num;
+	int slice_num;
+	// slice_num images of width * height * sample_num bytes in instance order
+	std::vector<unsigned char> pixels;
+};
 
 class DICOM_READER_EXPORT DcmData {
 public:
-	DcmData(std::string dcm_path, bool dcm_multiFrame = false);
+	DcmData(std::string dcm_path, bool dcm_multiFrame = false, DcmLoadOptions options = DcmLoadOptions());
 	~DcmData();
 
 	void LoadSingleFrameData(std::string file_path);
 	void LoadMultiFrameData(std::string file_path);
 
+	// Playback of a multi frame file too large to load, e.g. a long DSA run:
+	// only the header is read and the geometry members are set, volume_buf
+	// stays empty. Frames decode on demand, at most window_size of them are held.
+	bool OpenFrameStream(std::string file_path, int window_size = 32);
+	// Frame frame_idx as a volume slice of img_width * img_height values, the
+	// frames after it are read ahead in the background while it is shown
+	bool ReadFrame(int frame_idx, short *dst);
+	void CloseFrameStream();
+
+	// Header pass over a folder into this object's own patient/study/series
+	// tree, loads on other DcmData objects can run at the same time
+	bool ScanFolder(std::string file_path);
+	// Series of the last scan, patients, studies and series in scan order
+	std::vector<DcmSeriesInfo> GetSeriesList() const;
+	// Read the patient, study and series descriptions of series_idx that a
+	// geometry_only_header scan skipped, GetSeriesList reports them afterwards
+	bool LoadSeriesDetails(int series_idx);
+	// Take the geometry and slice order of one scanned series without
+	// rescanning, volume_buf is dropped and DecodeSlices/LoadAsync decode it
+	bool SelectSeries(int series_idx);
+
+	// Decode every slice once into dst, slice k of the volume starts at
+	// dst + k * slice_stride, ordered the same way as volume_buf
+	bool DecodeSlices(short *dst, size_t slice_stride);
+
+	// Decode volume slices [first_slice, first_slice + slice_count) into dst,
+	// slice first_slice + k starts at dst + k * slice_stride
+	bool DecodeSlab(int first_slice, int slice_count, short *dst, size_t slice_stride);
+	// One ordered pass over a volume too large for RAM, load with decode_pixels
+	// off. The consumer gets slabs of up to slab_slices slices, at most two slabs
+	// are held at a time, and returns false to stop early.
+	bool ForEachSlab(int slab_slices, const std::function<bool(const short *slab, int first_slice, int slice_count)> &consumer);
+
+	// Decode on a background thread and return at once, the geometry is already
+	// valid. Slices go from the centre outwards, dst == nullptr fills volume_buf.
+	bool LoadAsync(short *dst = nullptr, size_t slice_stride = 0);
+	// Coarse to fine load of a selected series that is not decoded yet. Every
+	// slice_step-th slice is decoded first, in place in the full volume, and
+	// averaged over pixel_step x pixel_step blocks into coarse. The other slices
+	// then decode in the background like LoadAsync, the coarse ones are not decoded again.
+	bool LoadProgressive(DcmCoarseVolume &coarse, int slice_step = 4, int pixel_step = 2,
+		short *dst = nullptr, size_t slice_stride = 0);
+	// Lock free check of one volume slice
+	bool IsSliceReady(int slice_idx) const;
+	int ReadySliceCount() const;
+	// Block until volume slices [first, last] are decoded or the load ends,
+	// timeout_ms < 0 waits forever. Returns whether the whole range is ready,
+	// at once when no load, receiver or watcher is running to fill it.
+	bool WaitForSlices(int first, int last, int timeout_ms = -1);
+	void WaitForLoad();
+
+	// Decoded slices are kept across loads keyed by SOP Instance UID and rescale,
+	// up to max_bytes in least recently used order. 0 (the default) turns it off.
+	static void SetSliceCacheBudget(size_t max_bytes);
+	static DcmSliceCacheStats GetSliceCacheStats();
+	// Files indexed by the last ScanFolder and how long it took, zeros after a failed scan
+	DcmHeaderScanStats GetHeaderScanStats() const;
+
+	// Decode a folder (or a multi frame file) repeat times and return the best
+	// frames/s and MB/s of decoded output with its transfer syntax name. Run
+	// once per syntax on the same series to compare codecs with uncompressed loads.
+	static bool BenchmarkDecode(std::string dcm_path, bool dcm_multiFrame, DcmDecodeBenchmark &result,
+		int thread_num = 0, int repeat = 3);
+
+	// In-process C-STORE SCP on port. Received slices are registered and decoded
+	// while the association runs, store_dir (optional) also keeps them on disk.
+	// Replaces the scanned tree; try it locally with storescu localhost <port> *.dcm
+	bool StartReceiver(int port, std::string ae_title = "DCMREADER", std::string store_dir = std::string());
+	// Stop listening after the running association, received slices are kept
+	void StopReceiver();
+	int ReceivedSliceCount() const;
+	// Block until an association ends that was not waited for yet, timeout_ms < 0 waits forever
+	bool WaitForAssociation(int timeout_ms = -1);
+	// Incremental ingest of a spool folder: the files already there and every
+	// file finished later are registered and decoded once, nothing is reread.
+	// on_series_complete runs on the watch thread with the GetSeriesList index
+	// of a series that got no new slice for settle_ms. Shares the received tree with StartReceiver.
+	bool StartWatch(std::string folder, int settle_ms = 5000,
+		const std::function<void(int series_idx, int slice_num)> &on_series_complete = nullptr);
+	void StopWatch();
+	// Preview of series_idx of GetSeriesList for a study browser: slice_count
+	// evenly spaced slices scaled to fit max_size, rendered on a background pool
+	// without loading the series. Previews are kept process wide per Series
+	// Instance UID and the newest request renders first. Returns at once.
+	bool RequestPreview(int series_idx, int max_size = 128, int slice_count = 3);
+	// Requests the preview when needed and waits up to timeout_ms for it,
+	// timeout_ms < 0 waits forever. False when not ready or nothing was readable.
+	bool GetPreview(int series_idx, DcmPreview &preview, int max_size = 128, int slice_count = 3, int timeout_ms = -1);
+	// Load series_idx of GetSeriesList from the received slices into volume_buf,
+	// slices decoded on arrival are only copied, call again as the series grows:
+	// slices already in volume_buf are kept and only the new ones are decoded.
+	// Loaded slices are then dropped from memory, a later load of them reads
+	// the files in store_dir or the watched folder.
+	bool LoadReceivedSeries(int series_idx = 0);
+
 public:
+	DcmLoadOptions load_options;
+
 	std::string folder_path;
 	std::vector<std::string> file_names;
 
@@ -40,4 +263,67 @@ public:
 	float distance_source_patient;
 
 	short *volume_buf;
+
+private:
+	DicomSeriesData *FindSeries(int series_idx) const;
+	int FindReceivedSeries(const std::string &series_instance_UID, int &series_slice_num) const;
+	void BeginIngest(std::string ingest_folder);
+	std::string PreviewSources(int series_idx, int max_size, int slice_count,
+		std::vector<DicomPreviewSource> &sources);
+	void ParseHeaders(const std::function<bool(DicomCrawlEntry &)> &next_file,
+		std::vector<std::string> &file_paths);
+	void ReleaseParsedFiles();
+	void SortByPhysicalLayout(std::vector<int> &volume_order);
+	bool DecodeSlicesInOrder(short *dst, size_t slice_stride, std::vector<int> volume_order);
+	int DecodeSliceList(short *dst, size_t slice_stride, const std::vector<int> &volume_order,
+		int dst_first_slice, bool mark_ready);
+	void ResetSliceReady();
+	void MarkSliceReady(int slice_idx);
+	void MarkAllSlicesReady();
+	bool SliceRangeReady(int first, int last) const;
+	bool ReadMultiFrameHeader(DcmDataset *dataset, int &stored_bits, bool &is_signed, bool &is_inverted);
+	void ConvertFrame(const unsigned char *frame, short *dst, size_t pixel_num, int bits_allocated,
+		int bits_stored, bool is_signed, bool is_inverted, int sample_num, int planar_configuration);
+
+	// Patient/study/series tree owned by this load
+	DicomDataMgr *data_mgr;
+	DcmHeaderScanStats header_scan_stats;
+
+	// Slice files in instance number order, resolved by the header pass
+	std::vector<std::string> slice_files;
+	std::vector<std::string> slice_sops;
+	std::vector<DcmFileFormat *> slice_file_formats;
+	std::vector<DcmFileFormat *> parsed_files;
+	// On-disk position of each slice file, filled by the first physical order decode
+	std::vector<unsigned long long> slice_layout_keys;
+	std::mutex slice_layout_mutex;
+
+	// One bit per volume slice, set once the slice holds its final values
+	std::unique_ptr<std::atomic<uint64_t>[]> slice_ready_bits;
+	std::atomic<int> slice_ready_num;
+	std::atomic<bool> load_finished;
+	std::atomic<bool> load_cancelled;
+	std::thread load_thread;
+	std::mutex slice_ready_mutex;
+	std::condition_variable slice_ready_cv;
+
+	// Incoming datasets, decoded on arrival and owned until the next scan
+	std::unique_ptr<DicomSeriesAssembler> series_assembler;
+	std::unique_ptr<DicomStoreReceiver> store_receiver;
+	std::thread receive_thread;
+	std::unique_ptr<DicomFolderWatcher> folder_watcher;
+	int association_end_num;
+	int association_waited_num;
+	std::mutex association_mutex;
+	std::condition_variable association_cv;
+
+	// Started by the first preview request
+	std::unique_ptr<DicomPreviewLoader> preview_loader;
+
+	// Open multi frame file read frame by frame
+	std::unique_ptr<DicomFrameStream> frame_stream;
+	int frame_stream_window;
+	int frame_stored_bits;
+	bool frame_is_signed;
+	bool frame_is_inverted;
 };
@@ -88,6 +88,10 @@ Viewer::Viewer(QWidget *parent)	: QMainWindow(parent) {
 	connect(viewer3d->mouse_style, SIGNAL(startPick()), this, SLOT(onStartPickingCell()));
 	connect(viewer3d->mouse_style, SIGNAL(stopPick()), this, SLOT(onStopPickingCell()));
 	connect(ui.generateCameraBtn, SIGNAL(clicked()), this, SLOT(onGenerateCamera()));
+
+	progressiveLoadTimer = new QTimer(this);
+	progressiveLoadTimer->setInterval(200);
+	connect(progressiveLoadTimer, SIGNAL(timeout()), this, SLOT(swapFullResolutionVolumes()));
 }
 
 void Viewer::onOpenDicomFile() {
@@ -98,8 +102,10 @@ void Viewer::onOpenDicomFile() {
 	int n = viewer3d->volumes.size();
 
 	VolumeData<short> v;
-	v.readFromDicom(fileToOpen.toStdString());
+	v.readFromDicomProgressive(fileToOpen.toStdString());
 	viewer3d->addVolume(v, QString("Image ") + QString::number(n + 1));
+	if (v.isLoadingFullResolution())
+		progressiveLoadTimer->start();
 
 	if (!n) {
 		viewer_front->pos = viewer3d->slicePos[0] = viewer3d->lenX / 2.0;
@@ -296,6 +302,28 @@ void Viewer::updateAllViewers() {
 	viewer_front->updateView();
 }
 
+void Viewer::swapFullResolutionVolumes() {
+	bool swapped = false, pending = false;
+	for (int i = 0; i < viewer3d->volumes.size(); ++i) {
+		VolumeData<short> &v = viewer3d->volumes[i];
+		if (!v.isLoadingFullResolution())
+			continue;
+		if (!v.swapToFullResolution()) {
+			pending = true;
+			continue;
+		}
+		viewer3d->meshes[i] = viewer3d->isoSurface(v, viewer3d->isoValue[i]);
+		viewer3d->lenX = (v.dx * v.nx) > viewer3d->lenX ? (v.dx * v.nx) : viewer3d->lenX;
+		viewer3d->lenY = (v.dy * v.ny) > viewer3d->lenY ? (v.dy * v.ny) : viewer3d->lenY;
+		viewer3d->lenZ = (v.dz * v.nz) > viewer3d->lenZ ? (v.dz * v.nz) : viewer3d->lenZ;
+		swapped = true;
+	}
+	if (!pending)
+		progressiveLoadTimer->stop();
+	if (swapped)
+		updateAllViewers();
+}
+
 void Viewer::updateLayerName(QString str) {
 	if (currentLayerId < 0 || currentLayerId >= viewer3d->volumes.size())
 		return;
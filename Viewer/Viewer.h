@@ -4,6 +4,7 @@
 #include <QCheckBox>
 #include <QLabel>
 #include <QSlider>
+#include <QTimer>
 
 #include <QtWidgets/QMainWindow>
 #include "ui_Viewer.h"
@@ -104,6 +105,8 @@ public slots:
 	// ==========================  =============================
 	// ˢпؼ
 	void updateAllViewers();
+	// صݽɺȫֱ
+	void swapFullResolutionVolumes();
 
 private:
 	// ͼϢ
@@ -124,6 +127,7 @@ private:
 	QSignalMapper *closeSignalMapper;
 	QSignalMapper *selectSignalMapper2d;
 	QSignalMapper *closeSignalMapper2d;
+	QTimer *progressiveLoadTimer;
 	std::vector<LayerItem> layerItems;
 	std::vector<Layer2DItem> layer2dItems;
 	int currentLayerId = 0;
@@ -1,4 +1,5 @@
 #include "Viewer3D.h"
+#include <algorithm>
 
 #include <vtkRenderWindow.h>
 #include <vtkPolyDataMapper.h>
@@ -167,20 +168,20 @@ void Viewer3D::updateView() {
 
 		vtkSmartPointer<vtkImageData> dsaImage = vtkSmartPointer<vtkImageData>::New();
 		dsaImage->SetDimensions(dsaImages[i].nx, dsaImages[i].ny, 1);
-		dsaImage->AllocateScalars(VTK_UNSIGNED_CHAR, 3);
+		dsaImage->AllocateScalars(VTK_SHORT, 1);
 		int basePtr = dsaFrames[i] * dsaImages[i].nx * dsaImages[i].ny;
-		for (unsigned int x = 0; x < dsaImages[i].nx; x++) {
-			for (unsigned int y = 0; y < dsaImages[i].ny; y++) {
-				unsigned char* pixel = static_cast<unsigned char*>(dsaImage->GetScalarPointer(x, y, 0));
-				pixel[0] = pixel[1] = pixel[2] = dsaImages[i].data[basePtr + (dsaImages[i].ny - y - 1) * dsaImages[i].nx + x];
-			}
+		for (unsigned int y = 0; y < dsaImages[i].ny; y++) {
+			short* row = static_cast<short*>(dsaImage->GetScalarPointer(0, y, 0));
+			short* src = dsaImages[i].data + basePtr + (dsaImages[i].ny - y - 1) * dsaImages[i].nx;
+			std::copy(src, src + dsaImages[i].nx, row);
 		}
 		dsaImage->Modified();
 
+		// Frames keep their stored bit depth, window them over the value range of the run
 		vtkSmartPointer<vtkImageMapper> imageMapper = vtkSmartPointer<vtkImageMapper>::New();
 		imageMapper->SetInputData(dsaImage);
-		imageMapper->SetColorWindow(255);
-		imageMapper->SetColorLevel(127.5);
+		imageMapper->SetColorWindow(dsaWindowWidth[i]);
+		imageMapper->SetColorLevel(dsaWindowCenter[i]);
 
 		vtkSmartPointer<vtkActor2D> actor_dsa = vtkSmartPointer<vtkActor2D>::New();
 		actor_dsa->SetMapper(imageMapper);
@@ -232,6 +233,14 @@ void Viewer3D::addDSAImage(VolumeData<short> v, QString title) {
 	dsaTitles.push_back(title);
 	dsaVisible.push_back(true);
 	dsaFrames.push_back(0);
+
+	short minValue = 0, maxValue = 255;
+	if (v.data != nullptr && v.nvox > 0) {
+		auto range = std::minmax_element(v.data, v.data + v.nvox);
+		minValue = *range.first, maxValue = *range.second;
+	}
+	dsaWindowWidth.push_back(std::max(maxValue - minValue, 1));
+	dsaWindowCenter.push_back((maxValue + minValue) / 2.0);
 }
 
 vtkSmartPointer<vtkPolyData> Viewer3D::isoSurface(VolumeData<short> &v, int isoValue, bool skipConnectivityFilter) {
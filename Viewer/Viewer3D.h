@@ -98,4 +98,6 @@ public:
 	std::vector<int> dsaFrames;
 	std::vector<bool> dsaVisible;
 	std::vector<QString> dsaTitles;
+	std::vector<int> dsaWindowWidth;
+	std::vector<double> dsaWindowCenter;
 };
@@ -9,6 +9,7 @@
 #endif
 
 #include <vector>
+#include <memory>
 #include <Eigen/Dense>
 #include <fstream>
 
@@ -30,6 +31,19 @@ public:
 	// Read data from Dicom file
 	void readFromDicom(std::string file_path);
 
+	// Read a reduced volume at once, every sliceStep-th slice at 1/pixelStep
+	// in-plane resolution, while the full volume decodes in the background
+	void readFromDicomProgressive(std::string file_path, int sliceStep = 4, int pixelStep = 2);
+
+	// Whether a progressive read still has its full resolution volume pending
+	bool isLoadingFullResolution();
+
+	// Replace the reduced volume by the full resolution one once it is decoded,
+	// false while it still decodes. Only the first copy to swap gets the full
+	// volume, the others stop waiting and keep the reduced data, which is
+	// freed once no copy points at it any more.
+	bool swapToFullResolution();
+
 	// Read data from DSA Dicom file
 	void readFromDSADicom(std::string file_path);
 
@@ -63,6 +77,11 @@ public:
 	int nx, ny, nz;
 	float dx, dy, dz;
 	int nvox;
+
+	// Load decoding the full resolution volume of a progressive read
+	std::shared_ptr<DcmData> pendingLoad;
+	// Reduced volume data points at until the swap, shared by the copies
+	std::shared_ptr<T> coarseData;
 };
 
 template <class T>
@@ -83,9 +102,25 @@ VolumeData<T>::~VolumeData() {
 		delete[] data;*/
 }
 
+// Other types decode into DcmData's buffer first and convert
+template <class T>
+inline void decodeDicomSlices(DcmData &dcmData, T *dst, int nvox) {
+	dcmData.volume_buf = new short[nvox];
+	dcmData.DecodeSlices(dcmData.volume_buf, dcmData.img_width * dcmData.img_height);
+	for (int i = 0; i < nvox; ++i)
+		dst[i] = dcmData.volume_buf[i];
+}
+
+// Short volumes take the decoded slices directly
+inline void decodeDicomSlices(DcmData &dcmData, short *dst, int nvox) {
+	dcmData.DecodeSlices(dst, dcmData.img_width * dcmData.img_height);
+}
+
 template <class T>
 void VolumeData<T>::readFromDicom(std::string file_path) {
-	DcmData dcmData(file_path);
+	DcmLoadOptions options;
+	options.decode_pixels = false;
+	DcmData dcmData(file_path, false, options);
 	nx = dcmData.img_width;
 	ny = dcmData.img_height;
 	nz = dcmData.slice_num;
@@ -94,8 +129,76 @@ void VolumeData<T>::readFromDicom(std::string file_path) {
 	dz = dcmData.img_slice_thickness;
 	nvox = nx * ny * nz;
 	data = new T[nvox];
+	decodeDicomSlices(dcmData, data, nvox);
+}
+
+// Other types copy the decoded volume
+template <class T>
+inline void takeDicomVolume(DcmData &dcmData, T *&dst, int nvox) {
+	dst = new T[nvox];
 	for (int i = 0; i < nvox; ++i)
-		data[i] = dcmData.volume_buf[i];
+		dst[i] = dcmData.volume_buf[i];
+}
+
+// Short volumes take over DcmData's buffer
+inline void takeDicomVolume(DcmData &dcmData, short *&dst, int nvox) {
+	dst = dcmData.volume_buf;
+	dcmData.volume_buf = nullptr;
+}
+
+template <class T>
+void VolumeData<T>::readFromDicomProgressive(std::string file_path, int sliceStep, int pixelStep) {
+	DcmLoadOptions options;
+	options.decode_pixels = false;
+	pendingLoad = std::make_shared<DcmData>(file_path, false, options);
+	DcmCoarseVolume coarse;
+	if (!pendingLoad->LoadProgressive(coarse, sliceStep, pixelStep)) {
+		pendingLoad.reset();
+		coarseData.reset();
+		nx = ny = nz = nvox = 0;
+		data = nullptr;
+		return;
+	}
+	nx = coarse.width;
+	ny = coarse.height;
+	nz = coarse.slice_num;
+	dx = coarse.pixel_spacing[0];
+	dy = coarse.pixel_spacing[1];
+	dz = coarse.slice_spacing;
+	nvox = nx * ny * nz;
+	coarseData.reset(new T[nvox], std::default_delete<T[]>());
+	data = coarseData.get();
+	for (int i = 0; i < nvox; ++i)
+		data[i] = coarse.values[i];
+}
+
+template <class T>
+bool VolumeData<T>::isLoadingFullResolution() {
+	return pendingLoad != nullptr;
+}
+
+template <class T>
+bool VolumeData<T>::swapToFullResolution() {
+	if (!pendingLoad || !pendingLoad->WaitForSlices(0, pendingLoad->slice_num - 1, 0))
+		return false;
+	DcmData &dcmData = *pendingLoad;
+	dcmData.WaitForLoad();
+	// The swap is one-shot on the shared load, a copy that swapped first took the buffer
+	if (dcmData.volume_buf == nullptr) {
+		pendingLoad.reset();
+		return false;
+	}
+	nx = dcmData.img_width;
+	ny = dcmData.img_height;
+	nz = dcmData.slice_num;
+	dx = dcmData.img_pixel_spacing[0];
+	dy = dcmData.img_pixel_spacing[1];
+	dz = dcmData.img_slice_thickness;
+	nvox = nx * ny * nz;
+	takeDicomVolume(dcmData, data, nvox);
+	pendingLoad.reset();
+	coarseData.reset();
+	return true;
 }
 
 template <class T>